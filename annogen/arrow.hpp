@@ -0,0 +1,848 @@
+#ifndef arrow_h
+#define arrow_h
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mapping.hpp"
+#include "coding.hpp"
+#include "frozen.hpp"
+#include "batch.hpp"
+
+
+// Arrow C data and C stream interfaces, as published in the Arrow format
+// specification; no Arrow library is needed to produce or consume them.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif
+
+#ifndef ARROW_C_STREAM_INTERFACE
+#define ARROW_C_STREAM_INTERFACE
+
+struct ArrowArrayStream {
+    int (*get_schema)(struct ArrowArrayStream*, struct ArrowSchema* out);
+    int (*get_next)(struct ArrowArrayStream*, struct ArrowArray* out);
+    const char* (*get_last_error)(struct ArrowArrayStream*);
+    void (*release)(struct ArrowArrayStream*);
+    void* private_data;
+};
+
+#endif
+
+
+// Schemas and arrays own their strings and buffers through private_data
+
+struct SchemaData {
+    std::string format;
+    std::string name;
+    std::string metadata;
+    std::vector<ArrowSchema*> children;
+    ArrowSchema* dictionary;
+};
+
+
+inline void release_schema(ArrowSchema* schema) {
+    if (!schema->release) {
+        return;
+    }
+    SchemaData* data = (SchemaData*)schema->private_data;
+    for (size_t i = 0; i < data->children.size(); ++i) {
+        if (data->children[i]->release) {
+            data->children[i]->release(data->children[i]);
+        }
+        delete data->children[i];
+    }
+    if (data->dictionary) {
+        if (data->dictionary->release) {
+            data->dictionary->release(data->dictionary);
+        }
+        delete data->dictionary;
+    }
+    delete data;
+    schema->release = nullptr;
+}
+
+
+inline ArrowSchema* make_schema(ArrowSchema* out, const std::string& format,
+                                const std::string& name, int64_t flags,
+                                const std::vector<ArrowSchema*>& children =
+                                    std::vector<ArrowSchema*>(),
+                                ArrowSchema* dictionary = nullptr) {
+    // Initialise `out`, taking ownership of heap-allocated `children` and
+    // `dictionary`
+    SchemaData* data = new SchemaData();
+    data->format = format;
+    data->name = name;
+    data->children = children;
+    data->dictionary = dictionary;
+    out->format = data->format.c_str();
+    out->name = data->name.c_str();
+    out->metadata = nullptr;
+    out->flags = flags;
+    out->n_children = data->children.size();
+    out->children = data->children.empty() ? nullptr : data->children.data();
+    out->dictionary = dictionary;
+    out->release = release_schema;
+    out->private_data = data;
+    return out;
+}
+
+
+struct ArrayData {
+    std::vector<std::vector<char>> buffers;
+    std::vector<const void*> pointers;
+    std::vector<ArrowArray*> children;
+    ArrowArray* dictionary;
+};
+
+
+inline void release_array(ArrowArray* array) {
+    if (!array->release) {
+        return;
+    }
+    ArrayData* data = (ArrayData*)array->private_data;
+    for (size_t i = 0; i < data->children.size(); ++i) {
+        if (data->children[i]->release) {
+            data->children[i]->release(data->children[i]);
+        }
+        delete data->children[i];
+    }
+    if (data->dictionary) {
+        if (data->dictionary->release) {
+            data->dictionary->release(data->dictionary);
+        }
+        delete data->dictionary;
+    }
+    delete data;
+    array->release = nullptr;
+}
+
+
+inline ArrowArray* make_array(ArrowArray* out, int64_t length, int64_t null_count,
+                              std::vector<std::vector<char>>& buffers,
+                              const std::vector<ArrowArray*>& children =
+                                  std::vector<ArrowArray*>(),
+                              ArrowArray* dictionary = nullptr) {
+    // Initialise `out`, moving `buffers` into it; the validity buffer (the
+    // first one) is omitted when there are no nulls
+    ArrayData* data = new ArrayData();
+    data->buffers.swap(buffers);
+    for (size_t i = 0; i < data->buffers.size(); ++i) {
+        data->pointers.push_back(
+            (i == 0 && null_count == 0) ? nullptr : data->buffers[i].data());
+    }
+    data->children = children;
+    data->dictionary = dictionary;
+    out->length = length;
+    out->null_count = null_count;
+    out->offset = 0;
+    out->n_buffers = data->pointers.size();
+    out->n_children = data->children.size();
+    out->buffers = data->pointers.data();
+    out->children = data->children.empty() ? nullptr : data->children.data();
+    out->dictionary = dictionary;
+    out->release = release_array;
+    out->private_data = data;
+    return out;
+}
+
+
+template <class T>
+inline void append(std::vector<char>& buffer, const T& value) {
+    const size_t size = buffer.size();
+    buffer.resize(size + sizeof(T));
+    std::memcpy(buffer.data() + size, &value, sizeof(T));
+}
+
+
+inline void set_metadata(ArrowSchema* schema,
+                         const std::vector<std::pair<std::string, std::string>>& items) {
+    // Attach key-value metadata to `schema` in the C data interface's
+    // encoding: the number of pairs, then each key and value prefixed by
+    // its length, all lengths as native int32
+    if (items.empty()) {
+        return;
+    }
+    std::vector<char> encoded;
+    append<int32_t>(encoded, (int32_t)items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        append<int32_t>(encoded, (int32_t)items[i].first.size());
+        encoded.insert(encoded.end(), items[i].first.begin(), items[i].first.end());
+        append<int32_t>(encoded, (int32_t)items[i].second.size());
+        encoded.insert(encoded.end(), items[i].second.begin(), items[i].second.end());
+    }
+    SchemaData* data = (SchemaData*)schema->private_data;
+    data->metadata.assign(encoded.begin(), encoded.end());
+    schema->metadata = data->metadata.data();
+}
+
+
+inline bool get_metadata(const ArrowSchema* schema, const std::string& key,
+                         std::string& value) {
+    // Read the value of `key` from the metadata of `schema` (see
+    // set_metadata); false if absent
+    const char* data = schema->metadata;
+    if (!data) {
+        return false;
+    }
+    int32_t n, size;
+    std::memcpy(&n, data, sizeof(n));
+    data += sizeof(n);
+    for (int32_t i = 0; i < n; ++i) {
+        std::memcpy(&size, data, sizeof(size));
+        data += sizeof(size);
+        const bool match = key.size() == (size_t)size &&
+                           std::memcmp(data, key.data(), size) == 0;
+        data += size;
+        std::memcpy(&size, data, sizeof(size));
+        data += sizeof(size);
+        if (match) {
+            value.assign(data, size);
+            return true;
+        }
+        data += size;
+    }
+    return false;
+}
+
+
+inline ArrowArray* make_strings(ArrowArray* out, const std::vector<std::string>& strings) {
+    // A utf8 array (e.g. a dictionary)
+    std::vector<std::vector<char>> buffers(3);
+    append<int32_t>(buffers[1], 0);
+    for (size_t i = 0; i < strings.size(); ++i) {
+        buffers[2].insert(buffers[2].end(), strings[i].begin(), strings[i].end());
+        append<int32_t>(buffers[1], buffers[2].size());
+    }
+    return make_array(out, strings.size(), 0, buffers);
+}
+
+
+class ListBuilder {
+    // Builds a nullable list column of a feature for one record batch
+
+private:
+
+    FeatureKind kind;
+    int64_t length;
+    int64_t nulls;
+    int64_t nvalues;
+    std::vector<char> validity;
+    std::vector<char> offsets;
+    std::vector<char> values;
+    std::vector<char> value_offsets;   // string values only
+
+    void mark(bool valid) {
+        if (length % 8 == 0) {
+            validity.push_back(0);
+        }
+        if (valid) {
+            validity.back() |= (char)(1 << (length % 8));
+        } else {
+            ++nulls;
+        }
+        ++length;
+    }
+
+public:
+
+    explicit ListBuilder(FeatureKind kind):
+        kind(kind), length(0), nulls(0), nvalues(0) {
+        append<int32_t>(offsets, 0);
+        append<int32_t>(value_offsets, 0);
+    }
+
+    void append_null() {
+        mark(false);
+        append<int32_t>(offsets, nvalues);
+    }
+
+    void append_numbers(const RecordsReader& reader) {
+        // 4-byte values are copied as is: record blobs and Arrow share the
+        // float and int32 layouts
+        mark(true);
+        values.insert(values.end(), (const char*)reader.values(),
+                      (const char*)reader.values() + 4 * reader.count);
+        nvalues += reader.count;
+        append<int32_t>(offsets, nvalues);
+    }
+
+    void append_strings(RecordsReader& reader) {
+        mark(true);
+        for (uint32_t i = 0; i < reader.count; ++i) {
+            reader.read_string();
+            values.insert(values.end(), reader.string_data,
+                          reader.string_data + reader.string_size);
+            append<int32_t>(value_offsets, values.size());
+        }
+        nvalues += reader.count;
+        append<int32_t>(offsets, nvalues);
+    }
+
+    void append_cached(const RecordsReader& reader,
+                       const std::vector<std::string>& cache) {
+        mark(true);
+        for (uint32_t i = 0; i < reader.count; ++i) {
+            const std::string& item = cache[reader.integer(i)];
+            values.insert(values.end(), item.begin(), item.end());
+            append<int32_t>(value_offsets, values.size());
+        }
+        nvalues += reader.count;
+        append<int32_t>(offsets, nvalues);
+    }
+
+    ArrowArray* finish(ArrowArray* out) {
+        std::vector<std::vector<char>> child_buffers(
+            kind == STRING_FEATURE || kind == CACHED_FEATURE ? 3 : 2);
+        if (child_buffers.size() == 3) {
+            child_buffers[1].swap(value_offsets);
+            child_buffers[2].swap(values);
+        } else {
+            child_buffers[1].swap(values);
+        }
+        ArrowArray* child = make_array(new ArrowArray(), nvalues, 0, child_buffers);
+        std::vector<std::vector<char>> buffers(2);
+        buffers[0].swap(validity);
+        buffers[1].swap(offsets);
+        return make_array(out, length, nulls, buffers,
+                          std::vector<ArrowArray*>(1, child));
+    }
+};
+
+
+inline const char* feature_format(FeatureKind kind) {
+    return kind == FLOAT_FEATURE ? "f" : kind == INT_FEATURE ? "i" : "u";
+}
+
+
+class ArrowExport {
+    // Exports all loci of a LocusTable or a FrozenTable as a sequence of
+    // record batches with columns contig (dictionary<int8, utf8>), pos
+    // (uint32), ref and alt (dictionary<int8, utf8>) followed by one
+    // nullable list column per feature; a null means the feature is absent.
+    // Exporting from a mapping that is modified in the meantime fails.
+    // Batches own their buffers: values are copied out of the record blobs
+    // (numbers in one memcpy per feature and locus), as loci are scattered
+    // over the table and cannot be shared with the consumer.
+
+private:
+
+    std::vector<FeatureSpec> features;
+    std::vector<std::string> contigs;
+    std::vector<std::string> bases;
+    const StringCache* stringcache;
+    size_t batch_size;
+    const uint64_t* version;
+    uint64_t expected_version;
+    const LocusTable* table;
+    LocusTable::const_iterator cursor;
+    const FrozenTable* frozen;
+    size_t position;
+    std::vector<std::pair<std::string, std::string>> metadata;
+
+    bool advance(uint64_t& key, const Records*& records) {
+        if (frozen) {
+            if (position == frozen->size()) {
+                return false;
+            }
+            key = frozen->key(position);
+            records = &frozen->record(position++);
+            return true;
+        }
+        if (cursor == table->end()) {
+            return false;
+        }
+        key = cursor->first.pack();
+        records = &cursor->second;
+        ++cursor;
+        return true;
+    }
+
+    ArrowArray* locus_column(ArrowArray* out, const std::vector<char>& codes,
+                             const std::vector<std::string>& dictionary) {
+        std::vector<std::vector<char>> buffers(2);
+        buffers[1] = codes;
+        return make_array(out, codes.size(), 0, buffers,
+                          std::vector<ArrowArray*>(),
+                          make_strings(new ArrowArray(), dictionary));
+    }
+
+public:
+
+    ArrowExport(const std::vector<FeatureSpec>& features,
+                const std::vector<std::string>& contigs,
+                const std::vector<std::string>& bases,
+                const StringCache* stringcache, size_t batch_size,
+                const uint64_t* version):
+        features(features), contigs(contigs), bases(bases),
+        stringcache(stringcache), batch_size(batch_size ? batch_size : 1),
+        version(version), expected_version(*version),
+        table(nullptr), frozen(nullptr), position(0) {}
+
+    void attach(const LocusTable* table) {
+        this->table = table;
+        cursor = table->begin();
+    }
+
+    void attach(const FrozenTable* frozen) {
+        this->frozen = frozen;
+        position = 0;
+    }
+
+    void describe(const std::string& key, const std::string& value) {
+        // Add a key-value pair to the schema metadata
+        metadata.push_back(std::make_pair(key, value));
+    }
+
+    void schema(ArrowSchema* out) const {
+        std::vector<ArrowSchema*> columns;
+        const char* locus_columns[] = {"contig", "pos", "ref", "alt"};
+        for (size_t i = 0; i < 4; ++i) {
+            if (i == 1) {
+                columns.push_back(make_schema(new ArrowSchema(), "I", "pos", 0));
+            } else {
+                columns.push_back(make_schema(
+                    new ArrowSchema(), "c", locus_columns[i], 0,
+                    std::vector<ArrowSchema*>(),
+                    make_schema(new ArrowSchema(), "u", "", 0)));
+            }
+        }
+        for (size_t i = 0; i < features.size(); ++i) {
+            ArrowSchema* item = make_schema(
+                new ArrowSchema(), feature_format(features[i].kind), "item",
+                ARROW_FLAG_NULLABLE);
+            columns.push_back(make_schema(
+                new ArrowSchema(), "+l", features[i].name, ARROW_FLAG_NULLABLE,
+                std::vector<ArrowSchema*>(1, item)));
+        }
+        make_schema(out, "+s", "", 0, columns);
+        set_metadata(out, metadata);
+    }
+
+    bool next(ArrowArray* out) {
+        // Fill `out` with the next record batch; return false at the end
+        if (*version != expected_version) {
+            throw std::runtime_error("the mapping was modified during export");
+        }
+        std::vector<char> contig_codes, ref_codes, alt_codes;
+        std::vector<char> positions;
+        std::vector<ListBuilder> builders;
+        std::vector<size_t> present(features.size(), (size_t)-1);
+        for (size_t i = 0; i < features.size(); ++i) {
+            builders.push_back(ListBuilder(features[i].kind));
+        }
+        const std::vector<std::string>& cache = stringcache->cache();
+        uint64_t key;
+        const Records* records;
+        size_t row = 0;
+        for (; row < batch_size && advance(key, records); ++row) {
+            const Locus locus = Locus::unpack(key);
+            contig_codes.push_back((char)locus.chrom);
+            append<uint32_t>(positions, locus.pos);
+            ref_codes.push_back(locus.ref);
+            alt_codes.push_back(locus.alt);
+            RecordsReader reader(*records);
+            while (reader.next()) {
+                const uint8_t code = reader.code;
+                if (features[code].kind == CACHED_FEATURE) {
+                    builders[code].append_cached(reader, cache);
+                } else if (reader.is_string) {
+                    builders[code].append_strings(reader);
+                } else {
+                    builders[code].append_numbers(reader);
+                }
+                present[code] = row;
+            }
+            for (size_t code = 0; code < features.size(); ++code) {
+                if (present[code] != row) {
+                    builders[code].append_null();
+                }
+            }
+        }
+        if (row == 0) {
+            return false;
+        }
+        std::vector<ArrowArray*> columns;
+        columns.push_back(locus_column(new ArrowArray(), contig_codes, contigs));
+        std::vector<std::vector<char>> buffers(2);
+        buffers[1].swap(positions);
+        columns.push_back(make_array(new ArrowArray(), row, 0, buffers));
+        columns.push_back(locus_column(new ArrowArray(), ref_codes, bases));
+        columns.push_back(locus_column(new ArrowArray(), alt_codes, bases));
+        for (size_t i = 0; i < builders.size(); ++i) {
+            columns.push_back(builders[i].finish(new ArrowArray()));
+        }
+        std::vector<std::vector<char>> validity(1);
+        make_array(out, row, 0, validity, columns);
+        return true;
+    }
+};
+
+
+struct ExportStream {
+    ArrowExport* exporter;
+    std::string error;
+    void* owner;                    // keeps the exported mapping alive
+    void (*release_owner)(void*);
+};
+
+
+inline int export_get_schema(ArrowArrayStream* stream, ArrowSchema* out) {
+    ExportStream* data = (ExportStream*)stream->private_data;
+    try {
+        data->exporter->schema(out);
+    } catch (const std::exception& e) {
+        data->error = e.what();
+        return EINVAL;
+    }
+    return 0;
+}
+
+
+inline int export_get_next(ArrowArrayStream* stream, ArrowArray* out) {
+    ExportStream* data = (ExportStream*)stream->private_data;
+    try {
+        if (!data->exporter->next(out)) {
+            out->release = nullptr;   // end of stream
+        }
+    } catch (const std::exception& e) {
+        data->error = e.what();
+        return EINVAL;
+    }
+    return 0;
+}
+
+
+inline const char* export_get_last_error(ArrowArrayStream* stream) {
+    ExportStream* data = (ExportStream*)stream->private_data;
+    return data->error.empty() ? nullptr : data->error.c_str();
+}
+
+
+inline void export_release(ArrowArrayStream* stream) {
+    if (!stream->release) {
+        return;
+    }
+    ExportStream* data = (ExportStream*)stream->private_data;
+    delete data->exporter;
+    data->release_owner(data->owner);
+    delete data;
+    stream->release = nullptr;
+}
+
+
+inline void export_stream(ArrowExport* exporter, void* owner,
+                          void (*release_owner)(void*), ArrowArrayStream* out) {
+    // Initialise `out`, taking ownership of the heap-allocated `exporter`;
+    // `release_owner(owner)` is called once the stream is released
+    ExportStream* data = new ExportStream();
+    data->exporter = exporter;
+    data->owner = owner;
+    data->release_owner = release_owner;
+    out->get_schema = export_get_schema;
+    out->get_next = export_get_next;
+    out->get_last_error = export_get_last_error;
+    out->release = export_release;
+    out->private_data = data;
+}
+
+
+class ArrowImport {
+    // Converts record batches (struct arrays) with the export's columns into
+    // LocusBatch entries and Records, encoding contigs, alleles and cached
+    // strings natively. Locus columns may be utf8, large utf8 or
+    // dictionary-encoded utf8, positions any integer type; feature columns
+    // may be lists (or large lists) of values, or plain values, where a null
+    // marks an absent feature. Float features accept any numeric values,
+    // int features integers and string features utf8 strings.
+
+private:
+
+    const std::vector<FeatureSpec>& features;
+    const ContigCoder& contigcoder;
+    const BaseCoder& basecoder;
+    StringCache& stringcache;
+    RecordArena& arena;
+    RecordsBuilder builder;
+
+    static bool is_integer(char format) {
+        return std::strchr("cCsSiIlL", format) != nullptr && format != 0;
+    }
+
+    static bool is_valid(const ArrowArray* array, int64_t i) {
+        const uint8_t* validity = (const uint8_t*)array->buffers[0];
+        i += array->offset;
+        return !validity || (validity[i / 8] >> (i % 8)) & 1;
+    }
+
+    static int64_t integer(const ArrowArray* array, char format, int64_t i) {
+        const void* data = array->buffers[1];
+        i += array->offset;
+        switch (format) {
+            case 'c': return ((const int8_t*)data)[i];
+            case 'C': return ((const uint8_t*)data)[i];
+            case 's': return ((const int16_t*)data)[i];
+            case 'S': return ((const uint16_t*)data)[i];
+            case 'i': return ((const int32_t*)data)[i];
+            case 'I': return ((const uint32_t*)data)[i];
+            case 'l': return ((const int64_t*)data)[i];
+            case 'L': return (int64_t)((const uint64_t*)data)[i];
+        }
+        throw std::invalid_argument(std::string("unsupported integer type ") + format);
+    }
+
+    static double number(const ArrowArray* array, char format, int64_t i) {
+        if (format == 'f') {
+            return ((const float*)array->buffers[1])[array->offset + i];
+        }
+        if (format == 'g') {
+            return ((const double*)array->buffers[1])[array->offset + i];
+        }
+        return (double)integer(array, format, i);
+    }
+
+    static void string(const ArrowArray* array, char format, int64_t i,
+                       const char*& data, size_t& size) {
+        i += array->offset;
+        int64_t start, stop;
+        if (format == 'u') {
+            start = ((const int32_t*)array->buffers[1])[i];
+            stop = ((const int32_t*)array->buffers[1])[i + 1];
+        } else if (format == 'U') {
+            start = ((const int64_t*)array->buffers[1])[i];
+            stop = ((const int64_t*)array->buffers[1])[i + 1];
+        } else {
+            throw std::invalid_argument(std::string("unsupported string type ") + format);
+        }
+        data = (const char*)array->buffers[2] + start;
+        size = stop - start;
+    }
+
+    template <class Coder>
+    static void encode_column(const ArrowSchema* schema, const ArrowArray* array,
+                              int64_t offset, int64_t length, const Coder& coder,
+                              const char* column, std::vector<int16_t>& codes) {
+        // Translate a (possibly dictionary-encoded) string column
+        const char* data;
+        size_t size;
+        codes.resize(length);
+        if (schema->dictionary) {
+            const char format = schema->dictionary->format[0];
+            std::vector<int16_t> dictionary(array->dictionary->length);
+            for (int64_t i = 0; i < array->dictionary->length; ++i) {
+                string(array->dictionary, format, i, data, size);
+                dictionary[i] = (int16_t)coder.encode(data, size);
+            }
+            for (int64_t i = 0; i < length; ++i) {
+                codes[i] = -1;
+                if (is_valid(array, offset + i)) {
+                    const int64_t index = integer(array, schema->format[0], offset + i);
+                    if (index >= 0 && index < (int64_t)dictionary.size()) {
+                        codes[i] = dictionary[index];
+                    }
+                }
+            }
+        } else {
+            for (int64_t i = 0; i < length; ++i) {
+                codes[i] = -1;
+                if (is_valid(array, offset + i)) {
+                    string(array, schema->format[0], offset + i, data, size);
+                    codes[i] = (int16_t)coder.encode(data, size);
+                }
+            }
+        }
+        for (int64_t i = 0; i < length; ++i) {
+            if (codes[i] < 0) {
+                throw std::invalid_argument(
+                    std::string("unknown or missing value in column '") + column +
+                    "' at row " + std::to_string(i));
+            }
+        }
+    }
+
+    void append_feature(uint8_t code, const ArrowSchema* schema,
+                        const ArrowArray* array, int64_t start, int64_t stop) {
+        // Append values [start, stop) of a value array as feature `code`
+        const char format = schema->format[0];
+        const FeatureKind kind = features[code].kind;
+        for (int64_t i = start; i < stop; ++i) {
+            if (!is_valid(array, i)) {
+                throw std::invalid_argument("null values in feature '" +
+                                            features[code].name + "'");
+            }
+        }
+        if (kind == FLOAT_FEATURE) {
+            if (!(format == 'f' || format == 'g' || is_integer(format))) {
+                throw std::invalid_argument("feature '" + features[code].name +
+                                            "' expects numbers");
+            }
+            builder.begin(code, false);
+            for (int64_t i = start; i < stop; ++i) {
+                builder.add_float((float)number(array, format, i));
+            }
+        } else if (kind == INT_FEATURE) {
+            if (!is_integer(format)) {
+                throw std::invalid_argument("feature '" + features[code].name +
+                                            "' expects integers");
+            }
+            builder.begin(code, false);
+            for (int64_t i = start; i < stop; ++i) {
+                const int64_t value = integer(array, format, i);
+                // uint64 values above INT64_MAX come back negative
+                if (value < INT32_MIN || value > INT32_MAX ||
+                    (format == 'L' && value < 0)) {
+                    throw std::overflow_error("value out of range for int "
+                                              "feature '" + features[code].name + "'");
+                }
+                builder.add_integer((int32_t)value);
+            }
+        } else {
+            const char* data;
+            size_t size;
+            builder.begin(code, kind != CACHED_FEATURE);
+            for (int64_t i = start; i < stop; ++i) {
+                string(array, format, i, data, size);
+                if (kind == CACHED_FEATURE) {
+                    builder.add_integer(stringcache.cache(std::string(data, size)));
+                } else {
+                    builder.add_string(data, size);
+                }
+            }
+        }
+    }
+
+public:
+
+    ArrowImport(const std::vector<FeatureSpec>& features,
+                const ContigCoder& contigcoder, const BaseCoder& basecoder,
+                StringCache& stringcache, RecordArena& arena):
+        features(features), contigcoder(contigcoder), basecoder(basecoder),
+        stringcache(stringcache), arena(arena) {}
+
+    void convert(const ArrowSchema* schema, const ArrowArray* array,
+                 LocusBatch& batch, std::vector<Records>& records) {
+        // Append every row of a record batch to `batch` and `records`;
+        // record blobs are allocated from `arena`
+        if (std::strcmp(schema->format, "+s") != 0) {
+            throw std::invalid_argument("expected a record batch (struct array)");
+        }
+        const int64_t length = array->length;
+        const int64_t offset = array->offset;
+        int locus_columns[4] = {-1, -1, -1, -1};
+        const char* locus_names[4] = {"contig", "pos", "ref", "alt"};
+        std::vector<int> feature_columns;  // feature code per column
+        for (int64_t c = 0; c < schema->n_children; ++c) {
+            const std::string name = schema->children[c]->name;
+            int code = -1;
+            for (int k = 0; k < 4; ++k) {
+                if (name == locus_names[k]) {
+                    locus_columns[k] = (int)c;
+                    code = -2;
+                }
+            }
+            for (size_t f = 0; f < features.size() && code == -1; ++f) {
+                if (features[f].name == name) {
+                    code = (int)f;
+                }
+            }
+            if (code == -1) {
+                throw std::invalid_argument("unknown column '" + name + "'");
+            }
+            feature_columns.push_back(code);
+        }
+        for (int k = 0; k < 4; ++k) {
+            if (locus_columns[k] < 0) {
+                throw std::invalid_argument(std::string("missing column '") +
+                                            locus_names[k] + "'");
+            }
+        }
+        std::vector<int16_t> contigs, refs, alts;
+        encode_column(schema->children[locus_columns[0]], array->children[locus_columns[0]],
+                      offset, length, contigcoder, "contig", contigs);
+        encode_column(schema->children[locus_columns[2]], array->children[locus_columns[2]],
+                      offset, length, basecoder, "ref", refs);
+        encode_column(schema->children[locus_columns[3]], array->children[locus_columns[3]],
+                      offset, length, basecoder, "alt", alts);
+        const ArrowSchema* pos_schema = schema->children[locus_columns[1]];
+        const ArrowArray* pos_array = array->children[locus_columns[1]];
+        if (!is_integer(pos_schema->format[0])) {
+            throw std::invalid_argument("column 'pos' must be integer");
+        }
+        const size_t first = records.size();
+        for (int64_t i = 0; i < length; ++i) {
+            const int64_t pos = integer(pos_array, pos_schema->format[0], offset + i);
+            if (pos < 0 || pos > UINT32_MAX || !is_valid(pos_array, offset + i)) {
+                throw std::invalid_argument("invalid position at row " + std::to_string(i));
+            }
+            batch.push_back((uint8_t)contigs[i], (uint32_t)pos, (char)refs[i], (char)alts[i]);
+        }
+        records.resize(first + length);
+        builder.clear();
+        for (int64_t i = 0; i < length; ++i) {
+            const int64_t row = offset + i;
+            for (size_t c = 0; c < feature_columns.size(); ++c) {
+                if (feature_columns[c] < 0) {
+                    continue;
+                }
+                const uint8_t code = (uint8_t)feature_columns[c];
+                const ArrowSchema* column_schema = schema->children[c];
+                const ArrowArray* column = array->children[c];
+                const char* format = column_schema->format;
+                if (!is_valid(column, row)) {
+                    continue;
+                }
+                if (std::strcmp(format, "+l") == 0) {
+                    const int32_t* offsets = (const int32_t*)column->buffers[1] + column->offset;
+                    append_feature(code, column_schema->children[0], column->children[0],
+                                   offsets[row], offsets[row + 1]);
+                } else if (std::strcmp(format, "+L") == 0) {
+                    const int64_t* offsets = (const int64_t*)column->buffers[1] + column->offset;
+                    append_feature(code, column_schema->children[0], column->children[0],
+                                   offsets[row], offsets[row + 1]);
+                } else {
+                    append_feature(code, column_schema, column, row, row + 1);
+                }
+            }
+            records[first + i] = builder.finish(arena);
+        }
+    }
+};
+
+
+#endif
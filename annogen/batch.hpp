@@ -0,0 +1,180 @@
+#ifndef batch_h
+#define batch_h
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+#include "mapping.hpp"
+#include "filter.hpp"
+#include "frozen.hpp"
+#include "simd.hpp"
+
+
+// Batched lookups. Probing keys one at a time serialises their cache misses;
+// here every group of BATCH keys goes through a software-pipelined sequence
+// of stages (group prefetching): filter block, hash and group header, item
+// slot, final probe. Each stage only touches memory prefetched by the
+// previous one, so up to BATCH misses are in flight at once. Keys and hashes
+// come precomputed from the pack_loci kernels (or hash_keys for policies
+// other than the default).
+
+static const size_t BATCH = 16;
+
+
+struct LocusBatch {
+    // A batch of loci in structure-of-arrays form for the pack kernels
+    std::vector<uint8_t> contigs;
+    std::vector<uint32_t> positions;
+    std::vector<char> refs;
+    std::vector<char> alts;
+    std::vector<uint64_t> keys;
+    std::vector<size_t> hashes;
+    bool hashed;                // whether `hashes` are filled
+    LocusHasher hashed_by;      // and by which policy
+
+    LocusBatch(): hashed(false), hashed_by(SPP_HASH) {}
+
+    void push_back(uint8_t contig, uint32_t pos, char ref, char alt) {
+        contigs.push_back(contig);
+        positions.push_back(pos);
+        refs.push_back(ref);
+        alts.push_back(alt);
+    }
+
+    size_t size() const {
+        return contigs.size();
+    }
+
+    void clear() {
+        contigs.clear();
+        positions.clear();
+        refs.clear();
+        alts.clear();
+        keys.clear();
+        hashes.clear();
+        hashed = false;
+    }
+
+    void pack(bool hash, LocusHasher hasher = SPP_HASH) {
+        // Fill `keys` and, if `hash`, the `hasher` hashes; only the default
+        // policy is hashed by the SIMD kernels along with packing, the
+        // others go through the scalar hash_keys loop afterwards
+        const bool fused = hash && hasher == SPP_HASH;
+        keys.resize(size());
+        hashes.resize(fused ? size() : 0);
+        pack_loci(contigs.data(), positions.data(), refs.data(), alts.data(),
+                  size(), keys.data(), fused ? hashes.data() : nullptr);
+        hashed = fused;
+        hashed_by = SPP_HASH;
+        if (hash && !fused) {
+            this->hash(hasher);
+        }
+    }
+
+    void hash(LocusHasher hasher) {
+        // Fill `hashes` from packed keys for `hasher`, unless they already
+        // are (e.g. when several tables share a batch and a policy)
+        if (hashed && hashed_by == hasher) {
+            return;
+        }
+        hashes.resize(size());
+        hash_keys(hasher, keys.data(), size(), hashes.data());
+        hashed = true;
+        hashed_by = hasher;
+    }
+};
+
+
+template <class Table>
+void lookup_batch(const Table& table, const LocusFilter& filter,
+                  const uint64_t* keys, const size_t* hashes, size_t n,
+                  const Records** out) {
+    // Write a pointer to the Records of each of `n` packed keys (or a null
+    // pointer if absent) to `out`; `hashes` must be the table's hashes. Any
+    // table backend (BasicLocusTable of either kind) will do
+    bool candidate[BATCH];
+    for (size_t first = 0; first < n; first += BATCH) {
+        const uint64_t* group = keys + first;
+        const size_t* hashed = hashes + first;
+        const size_t m = std::min(BATCH, n - first);
+        for (size_t i = 0; i < m; ++i) {
+            filter.prefetch(group[i]);
+        }
+        for (size_t i = 0; i < m; ++i) {
+            candidate[i] = filter.contains(group[i]);
+            if (candidate[i]) {
+                table.prefetch(hashed[i], false);
+            }
+        }
+        for (size_t i = 0; i < m; ++i) {
+            if (candidate[i]) {
+                table.prefetch(hashed[i], true);
+            }
+        }
+        for (size_t i = 0; i < m; ++i) {
+            if (!candidate[i]) {
+                out[first + i] = nullptr;
+                continue;
+            }
+            typename Table::const_iterator it = table.find_hashed(
+                Locus::unpack(group[i]), hashed[i]);
+            out[first + i] = it == table.end() ? nullptr : &it->second;
+        }
+    }
+}
+
+
+inline void lookup_batch(const FrozenTable& table, const LocusFilter& filter,
+                         const uint64_t* keys, size_t n, const Records** out) {
+    // Frozen counterpart of the above (no hashes needed): keys rejected by
+    // the filter are compacted away before the table is probed
+    const uint64_t* packed;
+    uint64_t candidates[BATCH];
+    size_t positions[BATCH];
+    const Records* found[BATCH];
+    for (size_t first = 0; first < n; first += BATCH) {
+        const size_t m = std::min(BATCH, n - first);
+        packed = keys + first;
+        for (size_t i = 0; i < m; ++i) {
+            filter.prefetch(packed[i]);
+        }
+        size_t ncandidates = 0;
+        for (size_t i = 0; i < m; ++i) {
+            out[first + i] = nullptr;
+            if (filter.contains(packed[i])) {
+                candidates[ncandidates] = packed[i];
+                positions[ncandidates++] = first + i;
+            }
+        }
+        table.find_batch(candidates, ncandidates, found);
+        for (size_t i = 0; i < ncandidates; ++i) {
+            out[positions[i]] = found[i];
+        }
+    }
+}
+
+
+
+template <class Table>
+void insert_batch(Table& table, LocusFilter& filter,
+                  const uint64_t* keys, const size_t* hashes, size_t n,
+                  Records* records) {
+    // Move `n` records into the table under their packed keys, prefetching
+    // the group of the key BATCH positions ahead; later duplicates win.
+    // `hashes` must be the table's hashes: keys are not hashed again
+    for (size_t i = 0; i < n && i < BATCH; ++i) {
+        table.prefetch(hashes[i], false);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (i + BATCH < n) {
+            table.prefetch(hashes[i + BATCH], false);
+        }
+        table.find_or_insert_hashed(Locus::unpack(keys[i]), hashes[i]) =
+            std::move(records[i]);
+        filter.insert(keys[i]);
+    }
+}
+
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef coding_h
+#define coding_h
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <string>
+#include <vector>
+
+
+// Native translation of contig names and alleles into Locus codes. Both
+// coders work on raw bytes, either one string at a time or on whole batches
+// of fixed-width, NUL-padded strings (e.g. NumPy 'S' arrays) or of
+// offset-delimited strings (e.g. Arrow string arrays). Unknown strings are
+// encoded as -1.
+
+
+class ContigCoder {
+    // A perfect hash over the (small) set of contig names: the seed is
+    // searched until every name lands in its own slot of a power-of-two
+    // table, so a lookup is one hash and one memcmp
+
+private:
+
+    std::vector<std::string> names; // slot -> name
+    std::vector<int16_t> slots;     // slot -> code or -1
+    uint64_t seed;
+    uint64_t mask;
+
+    static uint64_t hash(const char* data, size_t size, uint64_t seed) {
+        // FNV-1a over a seeded offset basis
+        uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+        for (size_t i = 0; i < size; ++i) {
+            h = (h ^ (uint8_t)data[i]) * 0x100000001b3ULL;
+        }
+        return h ^ (h >> 29);
+    }
+
+public:
+
+    ContigCoder(): names(1), slots(1, -1), seed(0), mask(0) {}
+
+    void build(const std::vector<std::string>& contigs) {
+        // Contig codes are positions in `contigs`; a repeated name takes the
+        // code of its last occurrence
+        std::map<std::string, int16_t> codes;
+        for (size_t code = 0; code < contigs.size(); ++code) {
+            codes[contigs[code]] = (int16_t)code;
+        }
+        uint64_t size = 1;
+        while (size < 2 * codes.size()) {
+            size <<= 1;
+        }
+        for (;; size <<= 1) {
+            mask = size - 1;
+            for (seed = 0; seed < 1024; ++seed) {
+                slots.assign(size, -1);
+                names.assign(size, std::string());
+                bool perfect = true;
+                for (std::map<std::string, int16_t>::const_iterator it = codes.begin();
+                     it != codes.end() && perfect; ++it) {
+                    const uint64_t slot = hash(it->first.data(), it->first.size(), seed) & mask;
+                    perfect = slots[slot] < 0;
+                    slots[slot] = it->second;
+                    names[slot] = it->first;
+                }
+                if (perfect) {
+                    return;
+                }
+            }
+        }
+    }
+
+    int encode(const char* data, size_t size) const {
+        const uint64_t slot = hash(data, size, seed) & mask;
+        return (slots[slot] >= 0 && names[slot].size() == size &&
+                std::memcmp(names[slot].data(), data, size) == 0) ? slots[slot] : -1;
+    }
+
+    void encode_fixed(const char* data, size_t itemsize, size_t n,
+                      int16_t* out) const {
+        for (size_t i = 0; i < n; ++i, data += itemsize) {
+            out[i] = (int16_t)encode(data, strnlen(data, itemsize));
+        }
+    }
+
+    void encode_offsets(const char* data, const int32_t* offsets, size_t n,
+                        int16_t* out) const {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = (int16_t)encode(data + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    }
+};
+
+
+class BaseCoder {
+    // A 256-entry lookup table from allele characters to codes; the empty
+    // allele has its own code. Non-ASCII characters (several UTF-8 bytes)
+    // fall back to a linear search of their own, so ASCII alphabets keep the
+    // single table lookup
+
+private:
+
+    int16_t table[256];
+    int16_t empty;
+    std::vector<std::pair<std::string, int16_t> > wide;
+
+    int encode_wide(const char* data, size_t size) const {
+        for (size_t i = 0; i < wide.size(); ++i) {
+            if (wide[i].first.size() == size &&
+                std::memcmp(wide[i].first.data(), data, size) == 0) {
+                return wide[i].second;
+            }
+        }
+        return -1;
+    }
+
+public:
+
+    BaseCoder(): empty(-1) {
+        std::fill(table, table + 256, (int16_t)-1);
+    }
+
+    void build(const std::vector<std::string>& bases) {
+        // Base codes are positions in `bases`; every base is the UTF-8
+        // encoding of at most one character
+        std::fill(table, table + 256, (int16_t)-1);
+        empty = -1;
+        wide.clear();
+        for (size_t code = 0; code < bases.size(); ++code) {
+            if (bases[code].empty()) {
+                empty = (int16_t)code;
+            } else if (bases[code].size() == 1) {
+                table[(uint8_t)bases[code][0]] = (int16_t)code;
+            } else {
+                wide.push_back(std::make_pair(bases[code], (int16_t)code));
+            }
+        }
+    }
+
+    int encode(const char* data, size_t size) const {
+        return size == 0 ? empty : size == 1 ? table[(uint8_t)data[0]] :
+               wide.empty() ? -1 : encode_wide(data, size);
+    }
+
+    void encode_fixed(const char* data, size_t itemsize, size_t n,
+                      int16_t* out) const {
+        for (size_t i = 0; i < n; ++i, data += itemsize) {
+            // without wide characters, two bytes are as bad as more
+            const size_t size = !wide.empty() ? strnlen(data, itemsize) :
+                                (itemsize > 1 && data[0] && data[1]) ? 2 : (data[0] != 0);
+            out[i] = (int16_t)encode(data, size);
+        }
+    }
+
+    void encode_offsets(const char* data, const int32_t* offsets, size_t n,
+                        int16_t* out) const {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = (int16_t)encode(data + offsets[i], offsets[i + 1] - offsets[i]);
+        }
+    }
+};
+
+
+#endif
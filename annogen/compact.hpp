@@ -0,0 +1,103 @@
+#ifndef compact_h
+#define compact_h
+
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "mapping.hpp"
+#include "records.hpp"
+#include "frozen.hpp"
+
+
+class Compaction {
+    // Copies live records into a fresh RecordArena and a fresh StringCache,
+    // leaving behind blobs of overwritten and deleted records as well as
+    // cached strings no longer referenced. Records without cached features
+    // are copied byte for byte, the others are rebuilt with translated
+    // string codes.
+
+private:
+
+    const std::vector<FeatureSpec>& features;
+    const StringCache& cache;
+    std::vector<uint8_t> cached;        // codes of cached features
+    std::vector<int32_t> translated;    // new code of each old string code
+    RecordsBuilder builder;
+
+public:
+
+    RecordArena arena;
+    StringCache strings;
+
+    Compaction(const std::vector<FeatureSpec>& features, const StringCache& cache):
+        features(features), cache(cache), translated(cache.size(), -1) {
+        for (size_t code = 0; code < features.size(); ++code) {
+            if (features[code].kind == CACHED_FEATURE) {
+                cached.push_back((uint8_t)code);
+            }
+        }
+    }
+
+    Records rewrite(const Records& records) {
+        bool has_cached = false;
+        for (size_t i = 0; i < cached.size() && !has_cached; ++i) {
+            has_cached = records.contains(cached[i]);
+        }
+        if (!has_cached) {
+            Records copy;
+            const size_t size = records.size();
+            if (size) {
+                std::memcpy(copy.allocate(size, arena), records.data(), size);
+            }
+            return copy;
+        }
+        RecordsReader reader(records);
+        while (reader.next()) {
+            builder.begin(reader.code, reader.is_string);
+            for (uint32_t i = 0; i < reader.count; ++i) {
+                if (reader.is_string) {
+                    reader.read_string();
+                    builder.add_string(reader.string_data, reader.string_size);
+                } else if (features[reader.code].kind == CACHED_FEATURE) {
+                    int32_t& code = translated[reader.integer(i)];
+                    if (code < 0) {
+                        code = strings.cache(cache.cache(reader.integer(i)));
+                    }
+                    builder.add_integer(code);
+                } else {
+                    // floats are copied bitwise as well
+                    builder.add_integer(reader.integer(i));
+                }
+            }
+        }
+        return builder.finish(arena);
+    }
+};
+
+
+inline void compact(LocusTable& table, const std::vector<FeatureSpec>& features,
+                    StringCache& cache, RecordArena& arena) {
+    // Rewrite all records of `table` into a fresh arena and string cache
+    Compaction compaction(features, cache);
+    for (LocusTable::iterator it = table.begin(); it != table.end(); ++it) {
+        it->second = compaction.rewrite(it->second);
+    }
+    arena.swap(compaction.arena);
+    cache.swap(compaction.strings);
+}
+
+
+inline void compact(FrozenTable& table, const std::vector<FeatureSpec>& features,
+                    StringCache& cache, RecordArena& arena) {
+    Compaction compaction(features, cache);
+    for (size_t i = 0; i < table.size(); ++i) {
+        table.record(i) = compaction.rewrite(table.record(i));
+    }
+    arena.swap(compaction.arena);
+    cache.swap(compaction.strings);
+}
+
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef filter_h
+#define filter_h
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "multiply.hpp"
+
+
+class LocusFilter {
+    // A blocked Bloom filter over packed Locus keys. All bits of a key are
+    // set within a single 512-bit block aligned to a cache line, so a
+    // negative lookup touches exactly one cache line. An empty (disabled)
+    // filter reports every key as possibly present.
+
+private:
+
+    static const size_t BLOCKWORDS = 8;
+    static const size_t BLOCKBITS = 512;
+
+    std::vector<uint64_t> words;    // over-allocated to align the blocks
+    uint64_t nblocks;
+    uint32_t nhashes;
+
+    static uint64_t hash(uint64_t key) {
+        // murmur3 finaliser
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdULL;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ULL;
+        return key ^ (key >> 33);
+    }
+
+    uint64_t* block(uint64_t h) const {
+        // pick a cache-line-aligned block from the high bits of the hash
+        uint64_t* first = (uint64_t*)(((uintptr_t)words.data() + 63) & ~(uintptr_t)63);
+        return first + BLOCKWORDS * mulhi64(h, nblocks);
+    }
+
+public:
+
+    LocusFilter(): words(0), nblocks(0), nhashes(0) {}
+
+    void init(size_t capacity, double fpr) {
+        // Size the filter for `capacity` keys at the false-positive rate
+        // `fpr`; blocking costs extra bits over a classic filter, the more so
+        // the lower the rate
+        if (!(fpr > 0 && fpr < 1)) {
+            throw std::invalid_argument("false positive rate must be in (0, 1)");
+        }
+        const double ln2 = std::log(2.0);
+        const double classic_bits = -std::log(fpr) / (ln2 * ln2);
+        const double bits_per_key = classic_bits * (1 - 0.15 * std::log10(fpr));
+        nhashes = (uint32_t)std::min(16.0, std::max(1.0, std::round(classic_bits * ln2)));
+        nblocks = std::max<uint64_t>(1, (uint64_t)std::ceil(bits_per_key * capacity / BLOCKBITS));
+        words.assign(nblocks * BLOCKWORDS + BLOCKWORDS - 1, 0);
+    }
+
+    void clear() {
+        words = std::vector<uint64_t>();
+        nblocks = 0;
+        nhashes = 0;
+    }
+
+    bool enabled() const {
+        return nblocks != 0;
+    }
+
+    void insert(uint64_t key) {
+        if (!enabled()) {
+            return;
+        }
+        const uint64_t h = hash(key);
+        uint64_t* b = block(h);
+        // double hashing within the block
+        uint32_t h1 = (uint32_t)h;
+        const uint32_t h2 = (uint32_t)(h >> 32) | 1;
+        for (uint32_t i = 0; i < nhashes; ++i, h1 += h2) {
+            b[(h1 >> 6) & (BLOCKWORDS - 1)] |= 1ULL << (h1 & 63);
+        }
+    }
+
+    bool contains(uint64_t key) const {
+        if (!enabled()) {
+            return true;
+        }
+        const uint64_t h = hash(key);
+        const uint64_t* b = block(h);
+        uint32_t h1 = (uint32_t)h;
+        const uint32_t h2 = (uint32_t)(h >> 32) | 1;
+        for (uint32_t i = 0; i < nhashes; ++i, h1 += h2) {
+            if (!(b[(h1 >> 6) & (BLOCKWORDS - 1)] & (1ULL << (h1 & 63)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void prefetch(uint64_t key) const {
+        if (enabled()) {
+            __builtin_prefetch(block(hash(key)));
+        }
+    }
+
+    size_t bytes() const {
+        return words.capacity() * sizeof(uint64_t);
+    }
+};
+
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef frozen_h
+#define frozen_h
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "mapping.hpp"
+#include "mphf.hpp"
+
+
+enum FrozenIndex {
+    EYTZINGER = 0,      // sorted keys in Eytzinger layout
+    PERFECT_HASH = 1    // minimal perfect hash over packed keys
+};
+
+
+class FrozenTable {
+    // An immutable, read-optimised replacement for a LocusTable. Packed keys
+    // are stored in a 1-based Eytzinger (BFS) layout: the first levels of the
+    // implicit search tree share a handful of cache lines and the next levels
+    // are prefetched while the current one is compared, so a lookup is a
+    // short branch-free descent instead of a probe chain over sparse groups.
+    // Alternatively, keys are placed by a minimal perfect hash function:
+    // a lookup is one MPHF evaluation (a few bits per key of index) and a
+    // single comparison against the stored packed key.
+    // Records live in a contiguous array aligned with the keys.
+
+private:
+
+    static const size_t BATCH = 16;  // keys in flight per batched lookup
+
+    FrozenIndex index;
+    std::vector<uint64_t> keys;     // keys[0] is an unused sentinel
+    std::vector<Records> records;   // records[i] belongs to keys[i]
+    MPHF mphf;
+
+    // Assign sorted items to the Eytzinger slots by an in-order traversal
+    size_t fill(std::vector<std::pair<uint64_t, Records*>>& sorted,
+                size_t i, size_t k) {
+        if (k < keys.size()) {
+            i = fill(sorted, i, 2 * k);
+            keys[k] = sorted[i].first;
+            records[k] = std::move(*sorted[i].second);
+            ++i;
+            i = fill(sorted, i, 2 * k + 1);
+        }
+        return i;
+    }
+
+    void build_eytzinger(LocusTable& table) {
+        std::vector<std::pair<uint64_t, Records*>> sorted;
+        sorted.reserve(table.size());
+        for (LocusTable::iterator it = table.begin(); it != table.end(); ++it) {
+            sorted.push_back(std::make_pair(it->first.pack(), &it->second));
+        }
+        std::sort(sorted.begin(), sorted.end(),
+                  [](const std::pair<uint64_t, Records*>& a,
+                     const std::pair<uint64_t, Records*>& b) {
+                      return a.first < b.first;
+                  });
+        keys.assign(sorted.size() + 1, 0);
+        records.clear();
+        records.resize(sorted.size() + 1);
+        fill(sorted, 0, 1);
+    }
+
+    void build_perfect_hash(LocusTable& table, double gamma) {
+        std::vector<uint64_t> packed;
+        packed.reserve(table.size());
+        for (LocusTable::iterator it = table.begin(); it != table.end(); ++it) {
+            packed.push_back(it->first.pack());
+        }
+        mphf.build(packed, gamma);
+        keys.assign(table.size() + 1, 0);
+        records.clear();
+        records.resize(table.size() + 1);
+        for (LocusTable::iterator it = table.begin(); it != table.end(); ++it) {
+            const uint64_t key = it->first.pack();
+            const uint64_t slot = mphf(key) + 1;
+            keys[slot] = key;
+            records[slot] = std::move(it->second);
+        }
+    }
+
+    const Records* find_eytzinger(uint64_t key) const {
+        const uint64_t* base = keys.data();
+        const size_t n = size();
+        size_t k = 1;
+        while (k <= n) {
+            // 8 keys per cache line: prefetch the great-great-grandchildren
+            __builtin_prefetch(base + 16 * k);
+            k = 2 * k + (base[k] < key);
+        }
+        // drop the trailing right turns and the final left turn
+        k >>= __builtin_ffsll((long long)~k);
+        return (k && base[k] == key) ? &records[k] : nullptr;
+    }
+
+    const Records* find_perfect_hash(uint64_t key) const {
+        const uint64_t slot = mphf(key) + 1;
+        return (slot < keys.size() && keys[slot] == key) ? &records[slot]
+                                                          : nullptr;
+    }
+
+    void find_batch_eytzinger(const uint64_t* batch, size_t n,
+                              const Records** out) const {
+        // Descend all trees in lockstep: the prefetches issued for one key
+        // overlap with the comparisons of the others
+        const uint64_t* base = keys.data();
+        const size_t size = this->size();
+        size_t k[BATCH];
+        for (size_t i = 0; i < n; ++i) {
+            k[i] = 1;
+        }
+        for (size_t depth = size; depth; depth >>= 1) {
+            for (size_t i = 0; i < n; ++i) {
+                if (k[i] <= size) {
+                    __builtin_prefetch(base + 16 * k[i]);
+                    k[i] = 2 * k[i] + (base[k[i]] < batch[i]);
+                }
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            k[i] >>= __builtin_ffsll((long long)~k[i]);
+            out[i] = (k[i] && base[k[i]] == batch[i]) ? &records[k[i]] : nullptr;
+        }
+    }
+
+    void find_batch_perfect_hash(const uint64_t* batch, size_t n,
+                                 const Records** out) const {
+        uint64_t slots[BATCH];
+        for (size_t i = 0; i < n; ++i) {
+            mphf.prefetch(batch[i]);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            slots[i] = mphf(batch[i]) + 1;
+            if (slots[i] < keys.size()) {
+                __builtin_prefetch(&keys[slots[i]]);
+                __builtin_prefetch(&records[slots[i]]);
+            }
+        }
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = (slots[i] < keys.size() && keys[slots[i]] == batch[i])
+                     ? &records[slots[i]] : nullptr;
+        }
+    }
+
+public:
+
+    FrozenTable(): index(EYTZINGER), keys(1, 0), records(1) {}
+
+    void build(LocusTable& table, FrozenIndex index = EYTZINGER,
+               double gamma = 2.0) {
+        // Move the contents of `table` into a frozen layout; `table` is
+        // emptied and its memory released
+        this->index = index;
+        if (index == PERFECT_HASH) {
+            build_perfect_hash(table, gamma);
+        } else {
+            build_eytzinger(table);
+        }
+        LocusTable(0, table.hash_function()).swap(table);
+    }
+
+    size_t size() const {
+        return keys.size() - 1;
+    }
+
+    uint64_t key(size_t i) const {
+        // Return the i-th packed key, 0 <= i < size()
+        return keys[i + 1];
+    }
+
+    const Records& record(size_t i) const {
+        // Return the records of the i-th packed key
+        return records[i + 1];
+    }
+
+    Records& record(size_t i) {
+        return records[i + 1];
+    }
+
+    size_t index_bytes() const {
+        return mphf.bytes();
+    }
+
+    FrozenIndex index_type() const {
+        return index;
+    }
+
+    const Records* find(const Locus& locus) const {
+        return (index == PERFECT_HASH ? find_perfect_hash(locus.pack())
+                                      : find_eytzinger(locus.pack()));
+    }
+
+    void find_batch(const uint64_t* batch, size_t n, const Records** out) const {
+        // Look up `n` packed keys, writing record pointers (or null pointers)
+        // to `out`; keys are processed in interleaved groups so that their
+        // cache misses overlap
+        for (size_t first = 0; first < n; first += BATCH) {
+            const size_t m = std::min(BATCH, n - first);
+            if (index == PERFECT_HASH) {
+                find_batch_perfect_hash(batch + first, m, out + first);
+            } else {
+                find_batch_eytzinger(batch + first, m, out + first);
+            }
+        }
+    }
+};
+
+
+#endif
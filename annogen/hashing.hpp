@@ -0,0 +1,295 @@
+#ifndef hashing_h
+#define hashing_h
+
+#include <cinttypes>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include "locus.hpp"
+#include "multiply.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+
+// Hash functions of a Locus. All but SppLocusHash hash the packed 64-bit key
+// (see Locus::pack), and all of them hash packed keys as well through
+// `packed`. hash_quality (see stats.hpp) compares them on real or synthetic
+// key sets; LocusHash (below) selects one for a LocusTable at runtime.
+
+
+struct SppLocusHash {
+    // std::hash<Locus>: four spp::hash_combine rounds over the fields
+    size_t operator()(const Locus& locus) const {
+        return std::hash<Locus>()(locus);
+    }
+
+    static size_t packed(uint64_t key) {
+        return std::hash<Locus>()(Locus::unpack(key));
+    }
+};
+
+
+struct MixLocusHash {
+    // One multiply-xorshift round over the packed key: the folded key times
+    // a 64-bit golden ratio, high half folded back into the bucket bits
+    size_t operator()(const Locus& locus) const {
+        return packed(locus.pack());
+    }
+
+    static size_t packed(uint64_t key) {
+        const uint64_t h = (key ^ key >> 32) * 0x9e3779b97f4a7c15ULL;
+        return h ^ h >> 32;
+    }
+};
+
+
+struct WyLocusHash {
+    // wyhash's integer hash (wyhash64) of the packed key: a 128-bit multiply
+    // folded to 64 bits, twice
+
+    static uint64_t wymix(uint64_t a, uint64_t b) {
+        uint64_t high;
+        const uint64_t low = mul128(a, b, high);
+        return low ^ high;
+    }
+
+    size_t operator()(const Locus& locus) const {
+        return packed(locus.pack());
+    }
+
+    static size_t packed(uint64_t key) {
+        static const uint64_t P0 = 0xa0761d6478bd642fULL;
+        static const uint64_t P1 = 0xe7037ed1a0b428dbULL;
+        uint64_t b = P1;
+        const uint64_t a = mul128(key ^ P0, b, b);
+        return wymix(a ^ P0, b ^ P1);
+    }
+};
+
+
+struct Xxh3LocusHash {
+    // XXH3_64bits of the packed key, seed 0 (the 4-8 byte path: one keyed
+    // xor and the rrmxmx finaliser)
+    size_t operator()(const Locus& locus) const {
+        return packed(locus.pack());
+    }
+
+    static size_t packed(uint64_t key) {
+        // XXH3's default secret: bytes 8-15 xor bytes 16-23
+        static const uint64_t BITFLIP = 0x1cad21f72c81017cULL ^ 0xdb979083e96dd4deULL;
+        uint64_t h = ((key << 32 | key >> 32) ^ BITFLIP);
+        h ^= (h << 49 | h >> 15) ^ (h << 24 | h >> 40);
+        h *= 0x9fb21c651e98df25ULL;
+        h ^= (h >> 35) + 8;
+        h *= 0x9fb21c651e98df25ULL;
+        return h ^ (h >> 28);
+    }
+};
+
+
+class Crc32c {
+    // CRC32C (Castagnoli) of a 64-bit word: one SSE4.2 crc32 instruction
+    // where available, a table-driven software fallback elsewhere
+
+private:
+
+    uint32_t table[8][256];
+    bool hardware;
+
+#if defined(__x86_64__)
+    __attribute__((target("sse4.2")))
+    static uint32_t crc_sse42(uint64_t word) {
+        return (uint32_t)_mm_crc32_u64(0xffffffff, word) ^ 0xffffffff;
+    }
+#endif
+
+public:
+
+    Crc32c(): hardware(false) {
+        // slicing-by-8 tables of the reflected polynomial
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = crc >> 1 ^ (crc & 1 ? 0x82f63b78 : 0);
+            }
+            table[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; ++i) {
+            for (int k = 1; k < 8; ++k) {
+                table[k][i] = table[k - 1][i] >> 8 ^ table[0][table[k - 1][i] & 0xff];
+            }
+        }
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        hardware = __builtin_cpu_supports("sse4.2");
+#endif
+    }
+
+    static const Crc32c& instance() {
+        static const Crc32c crc;
+        return crc;
+    }
+
+    bool accelerated() const {
+        return hardware;
+    }
+
+    uint32_t software(uint64_t word) const {
+        const uint32_t low = (uint32_t)word ^ 0xffffffff;
+        const uint32_t high = (uint32_t)(word >> 32);
+        return (table[7][low & 0xff] ^ table[6][low >> 8 & 0xff] ^
+                table[5][low >> 16 & 0xff] ^ table[4][low >> 24] ^
+                table[3][high & 0xff] ^ table[2][high >> 8 & 0xff] ^
+                table[1][high >> 16 & 0xff] ^ table[0][high >> 24]) ^ 0xffffffff;
+    }
+
+    uint32_t operator()(uint64_t word) const {
+#if defined(__x86_64__)
+        if (hardware) {
+            return crc_sse42(word);
+        }
+#endif
+        return software(word);
+    }
+};
+
+
+inline uint32_t crc32c(uint64_t word) {
+    // Inlined when compiling for SSE4.2 (e.g. -march=native), dispatched at
+    // runtime otherwise
+#if defined(__x86_64__) && defined(__SSE4_2__)
+    return (uint32_t)_mm_crc32_u64(0xffffffff, word) ^ 0xffffffff;
+#else
+    static const Crc32c& crc = Crc32c::instance();
+    return crc(word);
+#endif
+}
+
+
+struct Crc32cLocusHash {
+    // CRC32C of the packed key spread over 64 bits by a Fibonacci multiply:
+    // the low bits (bucket indices) only depend on the CRC's low bits, the
+    // high ones on all of them
+    size_t operator()(const Locus& locus) const {
+        return packed(locus.pack());
+    }
+
+    static size_t packed(uint64_t key) {
+        return (uint64_t)crc32c(key) * 0x9e3779b97f4a7c15ULL;
+    }
+};
+
+
+enum LocusHasher {
+    SPP_HASH = 0,
+    WYHASH = 1,
+    XXH3 = 2,
+    CRC32C = 3,
+    MIX = 4
+};
+
+static const int NHASHERS = 5;
+
+
+inline const char* hasher_name(LocusHasher hasher) {
+    static const char* names[NHASHERS] = {"spp", "wyhash", "xxh3", "crc32c", "mix"};
+    return names[hasher];
+}
+
+
+inline LocusHasher parse_hasher(const std::string& name) {
+    for (int i = 0; i < NHASHERS; ++i) {
+        if (name == hasher_name((LocusHasher)i)) {
+            return (LocusHasher)i;
+        }
+    }
+    throw std::invalid_argument("unknown hash function: " + name);
+}
+
+
+template <class Visit>
+void with_hasher(LocusHasher hasher, Visit visit) {
+    // Call `visit` with an instance of the hash functor selected by `hasher`
+    switch (hasher) {
+    case WYHASH:
+        visit(WyLocusHash());
+        break;
+    case XXH3:
+        visit(Xxh3LocusHash());
+        break;
+    case CRC32C:
+        visit(Crc32cLocusHash());
+        break;
+    case MIX:
+        visit(MixLocusHash());
+        break;
+    default:
+        visit(SppLocusHash());
+    }
+}
+
+
+class LocusHash {
+    // The hash policy of a LocusTable, chosen when the table is created. The
+    // switch is perfectly predicted within a table; batched paths hash whole
+    // arrays through hash_keys instead, one loop per policy
+
+private:
+
+    LocusHasher policy;
+
+public:
+
+    explicit LocusHash(LocusHasher policy = SPP_HASH): policy(policy) {}
+
+    LocusHasher hasher() const {
+        return policy;
+    }
+
+    size_t operator()(const Locus& locus) const {
+        switch (policy) {
+        case WYHASH:
+            return WyLocusHash()(locus);
+        case XXH3:
+            return Xxh3LocusHash()(locus);
+        case CRC32C:
+            return Crc32cLocusHash()(locus);
+        case MIX:
+            return MixLocusHash()(locus);
+        default:
+            return SppLocusHash()(locus);
+        }
+    }
+};
+
+
+template <class Hasher>
+void hash_keys(const uint64_t* keys, size_t n, size_t* hashes) {
+    for (size_t i = 0; i < n; ++i) {
+        hashes[i] = Hasher::packed(keys[i]);
+    }
+}
+
+
+inline void hash_keys(LocusHasher hasher, const uint64_t* keys, size_t n,
+                      size_t* hashes) {
+    // Write the `hasher` hashes of `n` packed keys to `hashes`
+    switch (hasher) {
+    case WYHASH:
+        return hash_keys<WyLocusHash>(keys, n, hashes);
+    case XXH3:
+        return hash_keys<Xxh3LocusHash>(keys, n, hashes);
+    case CRC32C:
+        return hash_keys<Crc32cLocusHash>(keys, n, hashes);
+    case MIX:
+        return hash_keys<MixLocusHash>(keys, n, hashes);
+    default:
+        return hash_keys<SppLocusHash>(keys, n, hashes);
+    }
+}
+
+
+#endif
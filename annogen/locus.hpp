@@ -0,0 +1,61 @@
+#ifndef locus_h
+#define locus_h
+
+#include <cinttypes>
+#include <cstddef>
+#include <functional>
+#include "sparsepp/spp.h"
+
+
+struct Locus {
+    // Genomic Locus
+    uint8_t chrom;
+    uint32_t pos;
+    char ref;
+    char alt;
+
+    Locus():
+        chrom(0), pos(0), ref(0), alt(0) {}
+    Locus(uint8_t chrom, uint32_t pos, char ref, char alt):
+        chrom(chrom), pos(pos), ref(ref), alt(alt) {}
+    Locus(uint8_t chrom, uint32_t pos, char ref):
+        chrom(chrom), pos(pos), ref(ref), alt(0) {}
+
+    bool operator==(const Locus& other) const {
+        return (chrom == other.chrom &&
+                pos == other.pos &&
+                ref == other.ref &&
+                alt == other.alt);
+    }
+
+    uint64_t pack() const {
+        // Pack the Locus into a single integer; packed keys sort in genomic
+        // order: by contig, then position, then ref and alt
+        return ((uint64_t)chrom << 48 | (uint64_t)pos << 16 |
+                (uint64_t)(uint8_t)ref << 8 | (uint64_t)(uint8_t)alt);
+    }
+
+    static Locus unpack(uint64_t key) {
+        return Locus((uint8_t)(key >> 48), (uint32_t)(key >> 16),
+                     (char)(key >> 8), (char)key);
+    }
+};
+
+
+namespace std {
+    // inject specialization of std::hash for Locus into namespace std
+    template<>
+    struct hash<Locus> {
+        std::size_t operator()(const Locus& locus) const {
+            std::size_t seed = 0;
+            spp::hash_combine(seed, locus.chrom);
+            spp::hash_combine(seed, locus.pos);
+            spp::hash_combine(seed, locus.ref);
+            spp::hash_combine(seed, locus.alt);
+            return seed;
+        }
+    };
+}
+
+
+#endif
@@ -8,74 +8,118 @@
 #include <string>
 #include <utility>
 #include "sparsepp/spp.h"
+#include "swiss.hpp"
+#include "records.hpp"
+#include "locus.hpp"
+#include "hashing.hpp"
 
 
-struct Locus {
-    // Genomic Locus
-    uint8_t chrom;
-    uint32_t pos;
-    char ref;
-    char alt;
-
-    Locus():
-        chrom(0), pos(0), ref(0), alt(0) {}
-    Locus(uint8_t chrom, uint32_t pos, char ref, char alt):
-        chrom(chrom), pos(pos), ref(ref), alt(alt) {}
-    Locus(uint8_t chrom, uint32_t pos, char ref):
-        chrom(chrom), pos(pos), ref(ref), alt(0) {}
-
-    bool operator==(const Locus& other) const {
-        return (chrom == other.chrom &&
-                pos == other.pos &&
-                ref == other.ref &&
-                alt == other.alt);
+struct FeatureMask {
+    // A set of feature codes: one bit for each of the 256 possible IDs
+    uint64_t words[4];
+
+    FeatureMask() {
+        clear();
+    }
+
+    void clear() {
+        words[0] = words[1] = words[2] = words[3] = 0;
+    }
+
+    void fill() {
+        words[0] = words[1] = words[2] = words[3] = ~(uint64_t)0;
+    }
+
+    void set(uint8_t code) {
+        words[code >> 6] |= (uint64_t)1 << (code & 63);
+    }
+
+    bool test(uint8_t code) const {
+        return words[code >> 6] >> (code & 63) & 1;
     }
 };
 
 
-namespace std {
-    // inject specialization of std::hash for Locus into namespace std
-    template<>
-    struct hash<Locus> {
-        std::size_t operator()(const Locus& locus) const {
-            std::size_t seed = 0;
-            spp::hash_combine(seed, locus.chrom);
-            spp::hash_combine(seed, locus.pos);
-            spp::hash_combine(seed, locus.ref);
-            spp::hash_combine(seed, locus.alt);
-            return seed;
-        }
-    };
-}
+// The backend of LocusTable, chosen at compile time: sparsepp's
+// sparse_hash_map (the default, compact) or, with ANNOGEN_SWISS_TABLE=1, a
+// Swiss table (see swiss.hpp: faster lookups, several times the slot memory)
+#ifndef ANNOGEN_SWISS_TABLE
+#define ANNOGEN_SWISS_TABLE 0
+#endif
 
+#if ANNOGEN_SWISS_TABLE
+static const char* const TABLE_BACKEND = "swiss";
 
-// Each record type is a pair of feature identifier and feature value;
-// Since feature IDs are stored as uint8_t, there can be up to 256 unique IDs
-typedef std::pair<uint8_t , std::vector<std::string>> StringRecs;  // string records
-typedef std::pair<uint8_t, std::vector<float>> FloatRecs;          // float records
-typedef std::pair<uint8_t, std::vector<int32_t>> IntRecs;          // int records
+template <class Hasher>
+using BasicLocusTable = swiss::SwissTable<Locus, Records, Hasher>;
+#else
+static const char* const TABLE_BACKEND = "sparsepp";
 
+template <class Hasher>
+using BasicLocusTable = spp::sparse_hash_map<Locus, Records, Hasher>;
+#endif
 
-struct Records {
-    // Records associated with a Locus.
-    std::vector<std::pair<uint8_t , std::vector<std::string>>> strings;
-    std::vector<std::pair<uint8_t, std::vector<float>>> floats;
-    std::vector<std::pair<uint8_t, std::vector<int32_t>>> integers;
+// the table of a GenomeMapping: its hash policy is picked at runtime (see
+// LocusHash); C++ users may fix one at compile time with BasicLocusTable
+typedef BasicLocusTable<LocusHash> LocusTable;
 
-    Records():
-        strings(0), floats(0),  integers(0) {}
-    Records(const std::vector<std::pair<uint8_t , std::vector<std::string>>> & strings,
-            const std::vector<std::pair<uint8_t, std::vector<float>>> & floats,
-            const std::vector<std::pair<uint8_t, std::vector<int32_t>>> & integers):
-        strings(strings), floats(floats), integers(integers) {}
 
-    explicit operator bool() const {
-        return strings.size() || floats.size() || integers.size();
+inline void refill_table(LocusTable& table, LocusTable& target) {
+    // Copy the items of `table` (record handles, not blobs) into the empty
+    // `target`, sized for them with the load factors of `table`, and swap
+    // the two tables
+    target.max_load_factor(table.max_load_factor());
+    target.min_load_factor(table.min_load_factor());
+    target.reserve(table.size());
+    for (LocusTable::const_iterator it = table.begin(); it != table.end(); ++it) {
+        target.insert(*it);
     }
-};
+    table.swap(target);
+}
+
+
+inline void rehash_table(LocusTable& table, LocusHasher hasher) {
+    // Switch `table` to the hash policy `hasher`
+    if (table.hash_function().hasher() == hasher) {
+        return;
+    }
+    LocusTable rehashed(0, LocusHash(hasher));
+    refill_table(table, rehashed);
+}
+
+
+inline void shrink_table(LocusTable& table) {
+    // Shrink `table` to the fewest buckets that hold its items at its
+    // max_load_factor; resize(0) only shrinks below min_load_factor, which
+    // is 0 (never) by default
+    LocusTable shrunk(0, table.hash_function());
+    shrunk.max_load_factor(table.max_load_factor());
+    shrunk.reserve(table.size());
+    if (shrunk.bucket_count() < table.bucket_count()) {
+        refill_table(table, shrunk);
+    }
+}
+
+
+inline const Records* lookup(const LocusTable& table, const Locus& locus) {
+    // Return a pointer to the Records stored under `locus` or a null pointer;
+    // unlike operator[], this never inserts missing keys
+    LocusTable::const_iterator it = table.find(locus);
+    return it == table.end() ? nullptr : &it->second;
+}
 
+typedef spp::sparse_hash_set<uint64_t> KeySet;    // a set of packed keys
+
+
+inline size_t erase_keys(LocusTable& table, const KeySet& keys) {
+    // Erase the loci of all packed keys in `keys`; return the number erased
+    size_t erased = 0;
+    for (KeySet::const_iterator it = keys.begin(); it != keys.end(); ++it) {
+        erased += table.erase(Locus::unpack(*it));
+    }
+    return erased;
+}
 
-typedef spp::sparse_hash_map<Locus, Records> LocusTable;
 
 class StringCache {
 
@@ -89,7 +133,7 @@ public:
 
     StringCache(): cachemap(0), strings(0) {}
 
-    int32_t size() {
+    int32_t size() const {
         return strings.size();
     }
 
@@ -106,7 +150,7 @@ public:
         return position;
     }
 
-    std::string cache(int32_t entry_code) {
+    std::string cache(int32_t entry_code) const {
         // Return string for an ID
         // note: although returning a const reference seems more efficient,
         //       the reference might get invalidated by future insertions,
@@ -117,9 +161,19 @@ public:
         return strings[entry_code];
     }
 
-    const std::vector<std::string>& cache() {
+    const std::vector<std::string>& cache() const {
         return strings;
     }
+
+    const spp::sparse_hash_map<std::string, int32_t>& map() const {
+        return cachemap;
+    }
+
+    void swap(StringCache& other) {
+        cachemap.swap(other.cachemap);
+        strings.swap(other.strings);
+        std::swap(sizelimit, other.sizelimit);
+    }
 };
 
 
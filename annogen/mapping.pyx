@@ -1,41 +1,106 @@
 # distutils: language=c++
 # cython: language_level=3, c_string_type=unicode, c_string_encoding=utf8
 
-from typing import Dict, Tuple, Union, Iterable, NamedTuple, Mapping, List
+from typing import (Dict, Tuple, Union, Iterable, NamedTuple, Mapping, List,
+                    Optional, Sequence)
 from numbers import Integral, Real
+from operator import length_hint
+from os import PathLike
 
-from libc.stdint cimport uint8_t, int32_t, uint32_t, uint64_t
+from libc.stdint cimport uint8_t, int16_t, int32_t, uint32_t, uint64_t
 from libcpp cimport bool as cbool
 from libcpp.string cimport string
 from libcpp.vector cimport vector
 from libcpp.pair cimport pair
+from cpython.buffer cimport (PyObject_GetBuffer, PyBuffer_Release,
+                             PyBUF_C_CONTIGUOUS, PyBUF_FORMAT)
+from cpython.pycapsule cimport PyCapsule_New, PyCapsule_GetPointer
+from cpython.ref cimport Py_INCREF, Py_DECREF
+from libc.stdlib cimport malloc, free
+from array import array
+from cython.operator cimport dereference as deref, preincrement as inc
 
 
 cdef:
     frozenset SUPPORTED_TYPES = frozenset([str, int, float])
     char MAXBASES = 127
     char MAXCONTIGS = 127
+    dict FROZEN_INDICES = {'eytzinger': EYTZINGER, 'mphf': PERFECT_HASH}
+    size_t INSERT_BATCH = 4096
+    dict MERGE_POLICIES = {'keep': KEEP, 'overwrite': OVERWRITE,
+                           'concatenate': CONCATENATE, 'replace': REPLACE}
+    tuple LOCUS_COLUMNS = ('contig', 'pos', 'ref', 'alt')
+    dict HASHERS = {'spp': SPP_HASH, 'wyhash': WYHASH, 'xxh3': XXH3,
+                    'crc32c': CRC32C, 'mix': MIX}
 
 
-cdef extern from "mapping.hpp":
+cdef extern from "records.hpp":
+
+    cdef enum FeatureKind:
+        STRING_FEATURE
+        FLOAT_FEATURE
+        INT_FEATURE
+        CACHED_FEATURE
+
+    cdef cppclass FeatureSpec:
+        FeatureSpec(const string& name, FeatureKind kind)
+
+    cdef cppclass RecordArena:
+        RecordArena()
+        size_t bytes()
+        size_t used()
+        void clear()
+        void swap(RecordArena& other)
+
+    cdef cppclass Records:
+        Records()
+        size_t size() const
+        cbool is_inline() const
+        size_t nfeatures() const
+        cbool contains(uint8_t code) const
+        cbool operatorbool() const
+
+    cdef cppclass RecordsReader:
+        uint8_t code
+        cbool is_string
+        uint32_t count
+        const char* string_data
+        size_t string_size
+        RecordsReader()
+        RecordsReader(const Records& records)
+        cbool next()
+        cbool find(uint8_t code)
+        float number(size_t i) const
+        int32_t integer(size_t i) const
+        void read_string()
+
+    cdef cppclass RecordsBuilder:
+        RecordsBuilder() except +
+        void begin(uint8_t code, cbool is_string) except +
+        void add_float(float value) except +
+        void add_integer(int32_t value) except +
+        void add_string(const char* data, size_t size) except +
+        void clear()
+        Records finish(RecordArena& arena) except +
+
 
-    cdef cppclass StringRecs:
-        uint8_t first
-        vector[string] second
-        StringRecs()
-        StringRecs(uint8_t, vector[string])
+cdef extern from "hashing.hpp":
 
-    cdef cppclass FloatRecs:
-        uint8_t first
-        vector[float] second
-        FloatRecs()
-        FloatRecs(uint8_t, vector[float])
+    cdef enum LocusHasher:
+        SPP_HASH
+        WYHASH
+        XXH3
+        CRC32C
+        MIX
 
-    cdef cppclass IntRecs:
-        uint8_t first
-        vector[int32_t] second
-        IntRecs()
-        IntRecs(uint8_t, vector[int32_t])
+    cdef cppclass LocusHash:
+        LocusHash(LocusHasher policy)
+        LocusHasher hasher() const
+
+    const char* hasher_name(LocusHasher hasher)
+
+
+cdef extern from "mapping.hpp":
 
     cdef cppclass Locus:
         uint8_t chrom
@@ -46,21 +111,53 @@ cdef extern from "mapping.hpp":
         Locus(uint8_t chrom, uint32_t pos, char ref)
         Locus(uint8_t chrom, uint32_t pos, char ref, char alt)
         cbool operator==(const Locus& other) const
+        uint64_t pack() const
+        @staticmethod
+        Locus unpack(uint64_t key)
 
-    cdef cppclass Records:
-        vector[pair[uint8_t, vector[string]]] strings
-        vector[pair[uint8_t, vector[float]]] floats
-        vector[pair[uint8_t, vector[int32_t]]] integers
-        Records() except +
-        Records(const vector[pair[uint8_t, vector[string]]]& strings,
-                const vector[pair[uint8_t, vector[float]]]& floats,
-                const vector[pair[uint8_t, vector[int32_t]]]) except +
-        cbool operatorbool() const
+    const char* TABLE_BACKEND
 
     cdef cppclass LocusTable:
+        cppclass iterator:
+            pair[Locus, Records]& operator*()
+            iterator operator++()
+            cbool operator==(iterator)
+            cbool operator!=(iterator)
+        iterator begin()
+        iterator end()
         cbool contains(const Locus& key) const
         Records& operator[](const Locus& key)
+        size_t erase(const Locus& key)
         uint64_t size()
+        uint64_t bucket_count()
+        float load_factor()
+        float max_load_factor()
+        float min_load_factor()
+        void set_resizing_parameters(float shrink, float grow)
+        void reserve(uint64_t cnt) except +
+        LocusHash hash_function() const
+
+    cdef cppclass FeatureMask:
+        FeatureMask()
+        void clear()
+        void fill()
+        void set(uint8_t code)
+        cbool test(uint8_t code) const
+
+    const Records* lookup(const LocusTable& table, const Locus& locus)
+
+    void rehash_table(LocusTable& table, LocusHasher hasher) except +
+    void shrink_table(LocusTable& table) except +
+
+    cdef cppclass KeySet:
+        KeySet() except +
+        size_t count(uint64_t key) const
+        void insert(uint64_t key) except +
+        size_t erase(uint64_t key)
+        size_t size() const
+        void clear()
+
+    size_t erase_keys(LocusTable& table, const KeySet& keys)
 
     cdef cppclass StringCache:
         StringCache()
@@ -69,32 +166,462 @@ cdef extern from "mapping.hpp":
         string cache(int32_t entry_code) except +
         const vector[string]& cache()
 
+
+cdef extern from "Python.h":
+
+    const char* PyUnicode_AsUTF8AndSize(object unicode, Py_ssize_t* size) except NULL
+    object PyUnicode_DecodeUTF8(const char* data, Py_ssize_t size, const char* errors)
+
+
+cdef extern from "coding.hpp":
+
+    cdef cppclass ContigCoder:
+        ContigCoder() except +
+        void build(const vector[string]& contigs) except +
+        int encode(const char* data, size_t size)
+        void encode_fixed(const char* data, size_t itemsize, size_t n,
+                          int16_t* out)
+
+    cdef cppclass BaseCoder:
+        BaseCoder()
+        void build(const vector[string]& bases) except +
+        int encode(const char* data, size_t size)
+        void encode_fixed(const char* data, size_t itemsize, size_t n,
+                          int16_t* out)
+
+
+cdef extern from "filter.hpp":
+
+    cdef cppclass LocusFilter:
+        LocusFilter()
+        void init(size_t capacity, double fpr) except +
+        void clear()
+        cbool enabled()
+        void insert(uint64_t key)
+        cbool contains(uint64_t key)
+        size_t bytes()
+
+
+cdef extern from "frozen.hpp":
+
+    cdef enum FrozenIndex:
+        EYTZINGER
+        PERFECT_HASH
+
+    cdef cppclass FrozenTable:
+        FrozenTable() except +
+        void build(LocusTable& table, FrozenIndex index, double gamma) except +
+        uint64_t size()
+        FrozenIndex index_type()
+        uint64_t key(size_t i)
+        const Records* find(const Locus& locus)
+
+
+cdef extern from "batch.hpp":
+
+    cdef cppclass LocusBatch:
+        vector[uint64_t] keys
+        vector[size_t] hashes
+        LocusBatch() except +
+        void push_back(uint8_t contig, uint32_t pos, char ref, char alt) except +
+        size_t size()
+        void clear()
+        void pack(cbool hash, LocusHasher hasher) except +
+        void hash(LocusHasher hasher) except +
+
+    void lookup_batch(const LocusTable& table, const LocusFilter& filter,
+                      const uint64_t* keys, const size_t* hashes, size_t n,
+                      const Records** out)
+    void lookup_batch(const FrozenTable& table, const LocusFilter& filter,
+                      const uint64_t* keys, size_t n, const Records** out)
+    void insert_batch(LocusTable& table, LocusFilter& filter,
+                      const uint64_t* keys, const size_t* hashes, size_t n,
+                      Records* records)
+
+
+cdef extern from "merge.hpp":
+
+    cdef enum MergePolicy:
+        KEEP
+        OVERWRITE
+        CONCATENATE
+        REPLACE
+
+    cdef cppclass RecordsMerge:
+        RecordsMerge(const vector[FeatureSpec]& target_features,
+                     StringCache& target_cache, RecordArena& arena,
+                     const vector[FeatureSpec]& source_features,
+                     const StringCache& source_cache,
+                     MergePolicy policy) except +
+        Records merge(const Records* target, const Records& source) except +
+
+    void merge_tables(LocusTable& target, LocusFilter& filter,
+                      const int16_t* contigs, const int16_t* bases,
+                      const LocusTable* table, const FrozenTable* frozen,
+                      RecordsMerge& merge) except +
+
+
+cdef extern from "compact.hpp":
+
+    void compact_records "compact"(LocusTable& table,
+                                   const vector[FeatureSpec]& features,
+                                   StringCache& cache,
+                                   RecordArena& arena) except +
+    void compact_records "compact"(FrozenTable& table,
+                                   const vector[FeatureSpec]& features,
+                                   StringCache& cache,
+                                   RecordArena& arena) except +
+
+
+cdef extern from "memory.hpp":
+
+    cdef cppclass FeatureMemory:
+        size_t loci
+        size_t values
+        size_t bytes
+
+    cdef cppclass MemoryUsage:
+        size_t table_groups
+        size_t table_slots
+        size_t table_slack
+        size_t frozen_keys
+        size_t frozen_records
+        size_t frozen_index
+        size_t inline_records
+        size_t spilled_records
+        size_t record_blobs
+        size_t record_garbage
+        size_t arena_slack
+        size_t string_cache_strings
+        size_t string_cache_vector
+        size_t string_cache_map
+        size_t filter
+        size_t allocator_overhead
+        vector[FeatureMemory] features
+
+    MemoryUsage memory_usage(const LocusTable& table, const FrozenTable& frozen,
+                             const RecordArena& arena, const StringCache& cache,
+                             const LocusFilter& filter,
+                             size_t nfeatures) except +
+
+
+cdef extern from "stats.hpp":
+
+    cbool ANNOGEN_STATS
+
+    uint64_t stats_clock()
+
+    cdef cppclass LatencyHistogram:
+        uint64_t count() const
+        double mean() const
+        uint64_t min() const
+        uint64_t max() const
+        uint64_t percentile(double q) const
+
+    cdef cppclass MappingStats:
+        uint64_t lookups
+        uint64_t hits
+        uint64_t misses
+        uint64_t filter_rejects
+        uint64_t batches
+        uint64_t batch_loci
+        uint64_t batch_hits
+        uint64_t inserts
+        uint64_t inserted
+        uint64_t decodes
+        uint64_t decoded_values
+        uint64_t cache_hits
+        uint64_t cache_misses
+        LatencyHistogram lookup_latency
+        LatencyHistogram batch_latency
+        LatencyHistogram insert_latency
+        LatencyHistogram decode_latency
+        void clear()
+        void lookup(uint64_t start, const Records* found, cbool filtered)
+        void batch(uint64_t start, const Records* const* found, size_t n)
+        void insert(uint64_t start, size_t n)
+        void decode(uint64_t start, size_t values)
+        void cache(size_t n, size_t added)
+
+    cdef cppclass ProbeStats:
+        uint64_t size
+        uint64_t buckets
+        uint64_t displaced
+        uint64_t hash_collisions
+        uint64_t max_probes
+        double mean_probes
+        double mean_miss_probes
+        vector[uint64_t] probes
+
+    ProbeStats probe_stats(const LocusTable& table) except +
+
+    cdef cppclass HashQuality:
+        uint64_t size
+        uint64_t buckets
+        uint64_t empty_buckets
+        double expected_empty
+        uint64_t max_bucket_keys
+        double uniformity
+        uint64_t hash_collisions
+        uint64_t max_probes
+        double mean_probes
+        double mean_miss_probes
+        vector[uint64_t] probes
+        uint64_t avalanche_keys
+        double avalanche_mean
+        double avalanche_bias
+        double avalanche_worst
+        double index_worst
+
+    HashQuality hash_quality(const vector[uint64_t]& keys, LocusHasher hasher,
+                             double load_factor) except +
+    vector[uint64_t] packed_keys(const LocusTable& table,
+                                 const FrozenTable& frozen) except +
+
+
+cdef extern from "arrow.hpp":
+
+    cdef struct ArrowSchema:
+        void (*release)(ArrowSchema*)
+
+    cdef struct ArrowArray:
+        void (*release)(ArrowArray*)
+
+    cdef struct ArrowArrayStream:
+        int (*get_schema)(ArrowArrayStream*, ArrowSchema* out)
+        int (*get_next)(ArrowArrayStream*, ArrowArray* out)
+        const char* (*get_last_error)(ArrowArrayStream*)
+        void (*release)(ArrowArrayStream*)
+
+    cdef cppclass ArrowExport:
+        ArrowExport(const vector[FeatureSpec]& features,
+                    const vector[string]& contigs, const vector[string]& bases,
+                    const StringCache* stringcache, size_t batch_size,
+                    const uint64_t* version) except +
+        void attach(const LocusTable* table)
+        void attach(const FrozenTable* frozen)
+        void describe(const string& key, const string& value) except +
+
+    cbool get_metadata(const ArrowSchema* schema, const string& key,
+                       string& value) except +
+
+    void export_stream(ArrowExport* exporter, void* owner,
+                       void (*release_owner)(void*) noexcept,
+                       ArrowArrayStream* out)
+
+    cdef cppclass ArrowImport:
+        ArrowImport(const vector[FeatureSpec]& features,
+                    const ContigCoder& contigcoder, const BaseCoder& basecoder,
+                    StringCache& stringcache, RecordArena& arena)
+        void convert(const ArrowSchema* schema, const ArrowArray* array,
+                     LocusBatch& batch, vector[Records]& records) except +
+
+
+cdef void release_owner(void* owner) noexcept with gil:
+    Py_DECREF(<object>owner)
+
+
+cdef void release_stream_capsule(object capsule) noexcept:
+    cdef ArrowArrayStream* stream = <ArrowArrayStream*>PyCapsule_GetPointer(
+        capsule, 'arrow_array_stream')
+    if stream.release != NULL:
+        stream.release(stream)
+    free(stream)
+
+
+cdef class ArrowStream:
+    """
+    An Arrow record batch stream over all loci of a GenomeMapping; consumable
+    by anything implementing the Arrow PyCapsule interface, e.g.
+    `pyarrow.RecordBatchReader.from_stream` or `pyarrow.table`
+    """
+
+    cdef:
+        GenomeMapping mapping
+        size_t batch_size
+
+    def __init__(self, GenomeMapping mapping, size_t batch_size):
+        self.mapping = mapping
+        self.batch_size = batch_size
+
+    def __arrow_c_stream__(self, requested_schema=None):
+        cdef:
+            ArrowArrayStream* stream
+            ArrowExport* exporter
+        if requested_schema is not None:
+            raise NotImplementedError('the stream is only exported with its '
+                                      'own schema; cast the result instead')
+        stream = <ArrowArrayStream*>malloc(sizeof(ArrowArrayStream))
+        stream.release = NULL
+        capsule = PyCapsule_New(stream, 'arrow_array_stream',
+                                release_stream_capsule)
+        exporter = self.mapping.exporter(self.batch_size)
+        Py_INCREF(self.mapping)
+        export_stream(exporter, <void*>self.mapping, release_owner, stream)
+        return capsule
+
+
+cdef class RecordView:
+    """
+    A read-only view of the features stored for a single locus. Values are
+    decoded on access (`view['AF']` or `view.AF`) rather than up front, so a
+    lookup only allocates the view itself. A view taken with a `features`
+    projection only shows those features. A view is invalidated by any
+    modification of its mapping; accessing an invalid view raises a
+    RuntimeError.
+    """
+
+    cdef:
+        GenomeMapping mapping
+        const Records* records
+        uint64_t version
+        FeatureMask mask        # the visible features
+        cbool projected         # whether `mask` hides any
+
+    @staticmethod
+    cdef RecordView wrap(GenomeMapping mapping, const Records* records,
+                         const FeatureMask* projection=NULL):
+        cdef RecordView view = RecordView.__new__(RecordView)
+        view.mapping = mapping
+        view.records = records
+        view.version = mapping._version
+        view.projected = projection != NULL
+        if view.projected:
+            view.mask = deref(projection)
+        else:
+            view.mask.fill()
+        return view
+
+    def __init__(self):
+        raise TypeError('RecordView objects are returned by '
+                        'GenomeMapping.getview and getviews')
+
+    cdef inline void check(self) except *:
+        if self.version != self.mapping._version:
+            raise RuntimeError('the mapping was modified after the view was '
+                               'created')
+
+    @property
+    def valid(self) -> bool:
+        return self.version == self.mapping._version
+
+    cdef inline cbool visible(self, feature):
+        return (feature in self.mapping._feature_ids and
+                self.mask.test(self.mapping.fcode(feature)))
+
+    def __getitem__(self, str feature) -> list:
+        self.check()
+        if not self.visible(feature):
+            raise KeyError(feature)
+        values = self.mapping.decode_feature(deref(self.records),
+                                             self.mapping.fcode(feature))
+        if values is None:
+            raise KeyError(feature)
+        return values
+
+    def __getattr__(self, str feature) -> list:
+        try:
+            return self[feature]
+        except KeyError:
+            raise AttributeError(feature) from None
+
+    def get(self, str feature, default=None):
+        self.check()
+        if not self.visible(feature):
+            return default
+        values = self.mapping.decode_feature(deref(self.records),
+                                             self.mapping.fcode(feature))
+        return default if values is None else values
+
+    def __contains__(self, feature) -> bool:
+        self.check()
+        return (self.visible(feature) and
+                self.records.contains(self.mapping.fcode(feature)))
+
+    def __len__(self):
+        self.check()
+        if self.projected:
+            return len(self.keys())
+        return self.records.nfeatures()
+
+    def __iter__(self):
+        return iter(self.keys())
+
+    def keys(self) -> List[str]:
+        self.check()
+        cdef:
+            list features = []
+            RecordsReader reader = RecordsReader(deref(self.records))
+        while reader.next():
+            if self.mask.test(reader.code):
+                features.append(self.mapping.feature(reader.code))
+        return features
+
+    def todict(self) -> dict:
+        """
+        Decode all visible features; same as the dict returned by `getitem`
+        with the view's projection
+        """
+        self.check()
+        return self.mapping.decode(deref(self.records),
+                                   &self.mask if self.projected else NULL)
+
+    def __repr__(self):
+        if not self.valid:
+            return '<RecordView (invalid)>'
+        return f'<RecordView {self.keys()}>'
+
  
 Site = Tuple[str, int, str, str]  #  chrom, pos, ref, alt
 # TODO explicitly ask for data types
 # TODO add cached_strings
 # TODO rewrite encoder and decoder 
 
+cdef dict summarise(const LatencyHistogram& histogram):
+    return {'count': histogram.count(), 'mean': histogram.mean(),
+            'min': histogram.min(), 'max': histogram.max(),
+            'p50': histogram.percentile(50), 'p90': histogram.percentile(90),
+            'p99': histogram.percentile(99), 'p999': histogram.percentile(99.9)}
+
+
 cdef class GenomeMapping:
 
     cdef:
         LocusTable mapping
+        RecordArena arena       # record blobs of `mapping` and `frozentable`
+        RecordArena scratch     # short-lived record blobs
+        RecordsBuilder builder
+        FrozenTable frozentable
+        cbool _frozen
+        LocusFilter filter
         StringCache stringcache
         set _cached
+        FeatureMask cached_mask  # codes of cached string features
+        FeatureMask float_mask   # codes of float features
         list _features
         dict _feature_ids
         dict _dtypes
         list _contigs
         dict _contig_ids
+        ContigCoder contigcoder
         list _bases
         dict _base_ids
+        BaseCoder basecoder
+        vector[FeatureSpec] featurespecs
+        uint64_t _version   # incremented by every modification
+        MappingStats _stats
 
     def __init__(self,
                  features: Mapping[str, type],
                  contigs: Iterable[str],
                  alphabet: Iterable[str],
                  cached_strings: Iterable[str],
-                 entries: Iterable[Site, Dict[str, List]]):
+                 entries: Iterable[Site, Dict[str, List]],
+                 expected_size: Optional[int] = None,
+                 min_load_factor: Optional[float] = None,
+                 max_load_factor: Optional[float] = None,
+                 filter_fpr: Optional[float] = None,
+                 str hash_function='spp'):
         """
         :param features: a mapping from feature to type: int, float or
         str; actual data are not required to be of these types, but they must
@@ -105,6 +632,25 @@ cdef class GenomeMapping:
         significant overhead and thus should only be used for really long
         repetitive strings (avoiding caching for strings shorter than 10
         characters and occurring less than 5 times is a rational rule of thumb);
+        :param expected_size: the expected number of loci; the table is sized
+        for this many entries up front to avoid rehashing during the bulk
+        load; if None, the size is inferred from `entries` whenever it is
+        sized (or provides a length hint);
+        :param min_load_factor: the load factor below which the table shrinks;
+        the table backend's default is used if None (sparsepp: 0.2, Swiss
+        table: 0, never shrink);
+        :param max_load_factor: the load factor above which the table grows;
+        the table backend's default is used if None (sparsepp: 0.5, Swiss
+        table: 0.875);
+        :param filter_fpr: if not None, build a Bloom filter over all loci with
+        this false-positive rate once the entries are loaded (see
+        `build_filter`);
+        :param hash_function: the hash policy of the table: 'spp' (sparsepp's
+        hash_combine over the locus fields), 'mix' (one multiply-xorshift
+        round), 'crc32c' (hardware CRC32C where available), 'wyhash' or
+        'xxh3'; see `hash_quality` to compare them on your data. Batched
+        paths (`insert_many`, `getitems`) hash 'spp' keys in the SIMD pack
+        kernels; the other policies hash the packed keys in a scalar loop
         """
         # initialise features
         self._dtypes = dict(features)
@@ -132,6 +678,8 @@ cdef class GenomeMapping:
             raise ValueError("alphabet can only be comprised of "
                              "single-character strings, except for the default "
                              "empty base string")
+        self.contigcoder.build(self._contigs)
+        self.basecoder.build(self._bases)
         # initialise the list of cached strings
         self._cached = set(cached_strings)
         if any(feature not in self._features for feature in self._cached):
@@ -139,34 +687,1072 @@ cdef class GenomeMapping:
                              '`features`')
         if any(self._dtypes[f] is not str for f in self._cached):
             raise ValueError('only string values can be cached')
-        for (contig, pos, ref, alt), annotations in entries:
-            self.insert(contig, pos, ref, alt, annotations)
+        for feature in self._cached:
+            self.cached_mask.set(self._feature_ids[feature])
+        for feature, dtype in self._dtypes.items():
+            if dtype is float:
+                self.float_mask.set(self._feature_ids[feature])
+        for feature in self._features:
+            self.featurespecs.push_back(FeatureSpec(
+                feature,
+                CACHED_FEATURE if feature in self._cached else
+                FLOAT_FEATURE if self._dtypes[feature] is float else
+                INT_FEATURE if self._dtypes[feature] is int else
+                STRING_FEATURE
+            ))
+        self.rehash(hash_function)
+        # size the table before the bulk load
+        if min_load_factor is not None or max_load_factor is not None:
+            self.set_resizing_parameters(
+                self.mapping.min_load_factor() if min_load_factor is None else
+                min_load_factor,
+                self.mapping.max_load_factor() if max_load_factor is None else
+                max_load_factor
+            )
+        if expected_size is None:
+            expected_size = length_hint(entries, 0)
+        if expected_size:
+            self.reserve(expected_size)
+        self.insert_many(entries)
+        if filter_fpr is not None:
+            self.build_filter(filter_fpr)
 
-    def insert(self, str contig, int pos, str ref, str alt, dict annotations):
+    def insert(self, str contig, uint32_t pos, str ref, str alt, dict annotations):
+        if self._frozen:
+            raise RuntimeError('cannot insert into a frozen mapping')
         cdef:
             uint8_t contig_code = self.ccode(contig)
             char ref_code = self.bcode(ref)
             char alt_code = self.bcode(alt)
             Locus locus = Locus(contig_code, pos, ref_code, alt_code)
             Records records = self.encode(annotations)
+            uint64_t start = stats_clock()
         self.mapping[locus] = records
+        self.filter.insert(locus.pack())
+        self._stats.insert(start, 1)
+        self._version += 1
+
+    def update(self, str contig, uint32_t pos, str ref, str alt,
+               dict annotations):
+        """
+        Replace the values of the given features of a stored locus and keep
+        its other features, like `dict.update`
+        :raises KeyError: if the locus is absent
+        """
+        self.patch(contig, pos, ref, alt, annotations, OVERWRITE)
+
+    def append(self, str contig, uint32_t pos, str ref, str alt,
+               dict annotations):
+        """
+        Append values to the given features of a stored locus; features the
+        locus lacks are added
+        :raises KeyError: if the locus is absent
+        """
+        self.patch(contig, pos, ref, alt, annotations, CONCATENATE)
+
+    def add_feature(self, str feature, dtype: type, cached: bool = False):
+        """
+        Declare a new feature; stored loci are left as they are and simply
+        lack it until it is set, e.g. with `add_column`
+        :param feature: feature name
+        :param dtype: int, float or str
+        :param cached: cache the feature's strings (see `__init__`)
+        """
+        if self._frozen:
+            raise RuntimeError('cannot add a feature to a frozen mapping')
+        if feature in self._feature_ids:
+            raise ValueError(f'feature "{feature}" already exists')
+        if dtype not in SUPPORTED_TYPES:
+            raise TypeError('dtype not in {}'.format(SUPPORTED_TYPES))
+        if cached and dtype is not str:
+            raise ValueError('only string values can be cached')
+        if len(self._features) == 256:
+            raise ValueError('there can be no more than 256 features')
+        cdef int code = len(self._features)
+        self._dtypes[feature] = dtype
+        self._features.append(feature)
+        self._feature_ids[feature] = code
+        if cached:
+            self._cached.add(feature)
+            self.cached_mask.set(code)
+        if dtype is float:
+            self.float_mask.set(code)
+        self.featurespecs.push_back(FeatureSpec(
+            feature,
+            CACHED_FEATURE if cached else
+            FLOAT_FEATURE if dtype is float else
+            INT_FEATURE if dtype is int else
+            STRING_FEATURE
+        ))
+        self._version += 1
+
+    def add_column(self, str feature, contigs, positions, refs, alts,
+                   values: Sequence, append: bool = False) -> int:
+        """
+        Set a feature of many stored loci at once, e.g. to enrich a mapping
+        with a new score; only the feature is rewritten, the other features
+        of each locus are copied as they are. Loci are given as columns, as in
+        `getitems_arrays`; absent loci are skipped.
+        :param feature: the feature to set; see `add_feature` to add new ones
+        :param values: a value or a list of values for each locus
+        :param append: append to the feature's values instead of replacing
+        them
+        :return: the number of loci updated
+        """
+        if self._frozen:
+            raise RuntimeError('cannot update a frozen mapping')
+        self.fcode(feature)
+        if len(values) != len(positions):
+            raise ValueError('all columns must have the same length')
+        cdef:
+            LocusBatch batch
+            list encoded = self.encode_arrays(contigs, positions, refs, alts,
+                                              batch)
+            vector[const Records*] found
+            RecordsMerge* merge
+            Records* slot
+            size_t i, j = 0, updated = 0
+        found.resize(batch.size())
+        self.find_batch(batch, found.data())
+        merge = new RecordsMerge(
+            self.featurespecs, self.stringcache, self.arena,
+            self.featurespecs, self.stringcache,
+            CONCATENATE if append else OVERWRITE)
+        try:
+            for i in range(len(encoded)):
+                if not encoded[i]:
+                    continue
+                # slots are stable, since nothing is inserted
+                slot = <Records*>found[j]
+                j += 1
+                if slot == NULL:
+                    continue
+                value = values[i]
+                try:
+                    self.encode_feature(
+                        feature,
+                        list(value) if isinstance(value, (list, tuple))
+                        else [value])
+                except:
+                    self.builder.clear()
+                    raise
+                slot[0] = merge.merge(slot, self.builder.finish(self.scratch))
+                updated += 1
+        finally:
+            del merge
+            self.scratch.clear()
+            self._version += 1
+        return updated
+
+    cdef void patch(self, str contig, uint32_t pos, str ref, str alt,
+                    dict annotations, MergePolicy policy) except *:
+        # merge `annotations` into the records of a stored locus
+        if self._frozen:
+            raise RuntimeError('cannot update a frozen mapping')
+        cdef:
+            Locus locus = Locus(self.ccode(contig), pos, self.bcode(ref),
+                                self.bcode(alt))
+            Records* existing = <Records*>lookup(self.mapping, locus)
+            Records records
+            RecordsMerge* merge
+        if existing == NULL:
+            raise KeyError((contig, pos, ref, alt))
+        records = self.encode(annotations, &self.scratch)
+        merge = new RecordsMerge(
+            self.featurespecs, self.stringcache, self.arena,
+            self.featurespecs, self.stringcache, policy)
+        try:
+            existing[0] = merge.merge(existing, records)
+        finally:
+            del merge
+            self.scratch.clear()
+        self._version += 1
+
+    def delete(self, str contig, uint32_t pos, str ref, str alt) -> bool:
+        """
+        Remove a locus; its memory is reclaimed by `compact`. A Bloom filter
+        (see `build_filter`) keeps reporting the locus as possibly present.
+        :return: False if the locus was absent
+        """
+        if self._frozen:
+            raise RuntimeError('cannot delete from a frozen mapping')
+        cdef:
+            int contig_code = self.ccode(contig, False)
+            int ref_code = self.bcode(ref, False)
+            int alt_code = self.bcode(alt, False)
+        if contig_code < 0 or ref_code < 0 or alt_code < 0:
+            return False
+        if not self.mapping.erase(Locus(contig_code, pos, ref_code, alt_code)):
+            return False
+        self._version += 1
+        return True
+
+    def compact(self):
+        """
+        Release memory held by deleted and overwritten records and by cached
+        strings that are no longer referenced: live records are copied into
+        a fresh arena and string cache, and a mutable table is shrunk to fit
+        its loci
+        """
+        if self._frozen:
+            compact_records(self.frozentable, self.featurespecs,
+                            self.stringcache, self.arena)
+        else:
+            compact_records(self.mapping, self.featurespecs, self.stringcache,
+                            self.arena)
+            shrink_table(self.mapping)
+        self._version += 1
+
+    def insert_many(self, entries: Iterable[Tuple[Site, Dict[str, List]]]):
+        """
+        Insert entries in bulk; equivalent to calling `insert` on each entry,
+        but keys are packed in SIMD batches (and hashed along with packing
+        under the default 'spp' hash function) and table probes are
+        prefetched ahead of the insertions
+        :param entries: ((contig, pos, ref, alt), annotations) pairs
+        """
+        if self._frozen:
+            raise RuntimeError('cannot insert into a frozen mapping')
+        cdef:
+            LocusBatch batch
+            vector[Records] records
+            uint8_t contig_code
+            uint32_t position
+            char ref_code
+            char alt_code
+        try:
+            for (contig, pos, ref, alt), annotations in entries:
+                contig_code = self.ccode(contig)
+                position = pos
+                ref_code = self.bcode(ref)
+                alt_code = self.bcode(alt)
+                records.push_back(self.encode(annotations))
+                batch.push_back(contig_code, position, ref_code, alt_code)
+                if batch.size() == INSERT_BATCH:
+                    self.insert_batch(batch, records)
+        finally:
+            # entries preceding a failed one are inserted, as with `insert`
+            self.insert_batch(batch, records)
+
+    cdef void insert_batch(self, LocusBatch& batch, vector[Records]& records):
+        cdef uint64_t start = stats_clock()
+        batch.pack(True, self.hasher())
+        insert_batch(self.mapping, self.filter, batch.keys.data(),
+                     batch.hashes.data(), batch.size(), records.data())
+        self._stats.insert(start, batch.size())
+        batch.clear()
+        records.clear()
+        self._version += 1
+
+    def insert_arrow(self, data, bint adopt_hash_function=False):
+        """
+        Insert all rows of Arrow data: a record batch, a table or a record
+        batch stream, given as any object implementing the Arrow PyCapsule
+        interface (e.g. pyarrow objects). Rows are decoded natively, without
+        creating Python objects. Columns must be named 'contig', 'pos', 'ref',
+        'alt' and after the features; see `ArrowImport` in arrow.hpp for the
+        supported column types. Data exported by annogen carry their hash
+        function in the schema metadata; data exported with another hash
+        function than this mapping's raise a ValueError, unless
+        `adopt_hash_function` is set and the mapping is empty.
+        :param adopt_hash_function: switch an empty mapping to the hash
+        function of the data (see `rehash`), keeping its reserved capacity
+        """
+        if self._frozen:
+            raise RuntimeError('cannot insert into a frozen mapping')
+        cdef:
+            ArrowArrayStream stream
+            ArrowArrayStream* source
+            ArrowSchema schema
+            ArrowSchema* source_schema
+            ArrowArray array
+            ArrowArray* source_array
+        schema.release = NULL
+        array.release = NULL
+        if hasattr(data, '__arrow_c_stream__'):
+            capsule = data.__arrow_c_stream__()
+            source = <ArrowArrayStream*>PyCapsule_GetPointer(
+                capsule, 'arrow_array_stream')
+            # take ownership of the stream
+            stream = source[0]
+            source.release = NULL
+            try:
+                if stream.get_schema(&stream, &schema):
+                    raise ValueError(self.stream_error(&stream))
+                self.check_hash_function(&schema, adopt_hash_function)
+                while True:
+                    if stream.get_next(&stream, &array):
+                        raise ValueError(self.stream_error(&stream))
+                    if array.release == NULL:
+                        break
+                    self.import_batch(&schema, &array)
+                    array.release(&array)
+            finally:
+                if array.release != NULL:
+                    array.release(&array)
+                if schema.release != NULL:
+                    schema.release(&schema)
+                stream.release(&stream)
+        elif hasattr(data, '__arrow_c_array__'):
+            schema_capsule, array_capsule = data.__arrow_c_array__()
+            source_schema = <ArrowSchema*>PyCapsule_GetPointer(
+                schema_capsule, 'arrow_schema')
+            source_array = <ArrowArray*>PyCapsule_GetPointer(
+                array_capsule, 'arrow_array')
+            self.check_hash_function(source_schema, adopt_hash_function)
+            self.import_batch(source_schema, source_array)
+        else:
+            raise TypeError('expected an object implementing the Arrow '
+                            'PyCapsule interface')
+
+    cdef void check_hash_function(self, const ArrowSchema* schema,
+                                  bint adopt) except *:
+        # keep imported data on the hash policy they were exported with
+        cdef:
+            string value
+            str hash_function
+            size_t capacity
+        if not get_metadata(schema, b'annogen.hash_function', value):
+            return
+        hash_function = value
+        if hash_function not in HASHERS:
+            raise ValueError(f'unknown hash function {hash_function!r} in '
+                             f'the Arrow schema metadata')
+        if hash_function == self.hash_function:
+            return
+        if not adopt or len(self):
+            raise ValueError(f'the data use the hash function '
+                             f'{hash_function!r}, this mapping '
+                             f'{self.hash_function!r}; rehash one of them '
+                             f'first (or pass adopt_hash_function=True to '
+                             f'an empty mapping)')
+        # keep the room reserved for the bulk load
+        capacity = <size_t>(self.mapping.bucket_count() *
+                            self.mapping.max_load_factor())
+        self.rehash(hash_function)
+        self.reserve(capacity)
+
+    cdef str stream_error(self, ArrowArrayStream* stream):
+        cdef const char* error = stream.get_last_error(stream)
+        return 'Arrow stream error' if error == NULL else error.decode()
+
+    cdef void import_batch(self, const ArrowSchema* schema,
+                           const ArrowArray* array) except *:
+        cdef:
+            ArrowImport* importer = new ArrowImport(
+                self.featurespecs, self.contigcoder, self.basecoder,
+                self.stringcache, self.arena)
+            LocusBatch batch
+            vector[Records] records
+        try:
+            importer.convert(schema, array, batch, records)
+        finally:
+            del importer
+        self.insert_batch(batch, records)
+
+    def insert_parquet(self, path,
+                       features: Optional[Iterable[str]] = None,
+                       columns: Optional[Mapping[str, str]] = None,
+                       row_groups: Optional[Iterable[int]] = None,
+                       int threads=1):
+        """
+        Insert rows of a Parquet file, reading only the locus columns and the
+        requested features. The file is read row group by row group, so the
+        cost and peak memory depend on the projected columns and the row
+        group size rather than on the file size. Each row group is decoded
+        natively as by `insert_arrow`. Requires pyarrow.
+        :param path: a path or, if `threads` is 1, a file-like object
+        :param features: features to load; if None, all features of the
+        mapping present in the file are loaded; other columns are never read
+        :param columns: renames file columns: maps locus column names
+        ('contig', 'pos', 'ref', 'alt') and features to file column names
+        :param row_groups: indices of row groups to read (all if None)
+        :param threads: the number of row groups read and decompressed
+        concurrently; insertion itself is sequential and in file order
+        """
+        if self._frozen:
+            raise RuntimeError('cannot insert into a frozen mapping')
+        if threads < 1:
+            raise ValueError('threads must be positive')
+        import pyarrow.parquet as pq
+        columns = dict(columns or {})
+        unknown = set(columns) - set(LOCUS_COLUMNS) - set(self._features)
+        if unknown:
+            raise ValueError(f'`columns` renames unknown columns: {unknown}')
+        available = set(pq.ParquetFile(path).schema_arrow.names)
+        if features is None:
+            features = [feature for feature in self._features
+                        if columns.get(feature, feature) in available]
+        else:
+            features = list(features)
+            if any(feature not in self._feature_ids for feature in features):
+                raise ValueError('`features` contains features absent in the '
+                                 'mapping')
+        names = list(LOCUS_COLUMNS) + features
+        file_names = [columns.get(name, name) for name in names]
+        missing = [name for name in file_names if name not in available]
+        if missing:
+            raise ValueError(f'columns missing in the Parquet file: {missing}')
+        # keep string locus columns dictionary-encoded: the importer
+        # translates each dictionary once instead of each row
+        dictionary = [file_names[0], file_names[2], file_names[3]]
+        source = pq.ParquetFile(path, read_dictionary=dictionary)
+        if row_groups is None:
+            row_groups = range(source.num_row_groups)
+        if threads == 1:
+            for index in row_groups:
+                self.insert_arrow(
+                    source.read_row_group(index, columns=file_names,
+                                          use_threads=False)
+                    .rename_columns(names)
+                )
+            return
+        if not isinstance(path, (str, PathLike)):
+            raise ValueError('reading in parallel requires a path')
+        from concurrent.futures import ThreadPoolExecutor
+        from collections import deque
+        from threading import local
+        readers = local()
+
+        def read(index):
+            # each worker thread has a reader of its own
+            if not hasattr(readers, 'source'):
+                readers.source = pq.ParquetFile(path, read_dictionary=dictionary,
+                                                memory_map=True)
+            return readers.source.read_row_group(index, columns=file_names,
+                                                 use_threads=False)
+
+        # pyarrow releases the GIL while decoding, so row groups are read in
+        # parallel; at most 2 * `threads` decoded row groups are held at once
+        with ThreadPoolExecutor(threads) as executor:
+            pending = deque()
+            for index in row_groups:
+                pending.append(executor.submit(read, index))
+                if len(pending) == 2 * threads:
+                    self.insert_arrow(pending.popleft().result()
+                                      .rename_columns(names))
+            while pending:
+                self.insert_arrow(pending.popleft().result()
+                                  .rename_columns(names))
+
+    def merge(self, GenomeMapping other, str policy='overwrite'):
+        """
+        Insert all loci of another mapping natively, without decoding them
+        into Python objects. Loci present in both mappings are merged feature
+        by feature: features found on one side only are kept as they are,
+        features found on both sides are resolved by `policy`. If merging
+        fails midway, the loci merged so far stay merged.
+        :param other: a mapping whose features are features of this mapping
+        with the same types (string features may differ in caching) and
+        whose contigs and alleles are all present in this mapping; it may be
+        frozen and is left unchanged
+        :param policy: 'keep' – existing values win; 'overwrite' – values of
+        `other` win; 'concatenate' – values of `other` are appended;
+        'replace' – loci of `other` replace existing loci as a whole
+        """
+        if self._frozen:
+            raise RuntimeError('cannot insert into a frozen mapping')
+        if other is self:
+            raise ValueError('cannot merge a mapping into itself')
+        if policy not in MERGE_POLICIES:
+            raise ValueError(f'policy must be one of {list(MERGE_POLICIES)}')
+        cdef:
+            vector[int16_t] contigs = vector[int16_t](256, -1)
+            vector[int16_t] bases = vector[int16_t](256, -1)
+            RecordsMerge* merge = new RecordsMerge(
+                self.featurespecs, self.stringcache, self.arena,
+                other.featurespecs, other.stringcache, MERGE_POLICIES[policy])
+        try:
+            for code, contig in enumerate(other._contigs):
+                contigs[code] = self._contig_ids.get(contig, -1)
+            for code, base in enumerate(other._bases):
+                bases[code] = self._base_ids.get(base, -1)
+            if other._frozen:
+                merge_tables(self.mapping, self.filter, contigs.data(),
+                             bases.data(), NULL, &other.frozentable, deref(merge))
+            else:
+                merge_tables(self.mapping, self.filter, contigs.data(),
+                             bases.data(), &other.mapping, NULL, deref(merge))
+        finally:
+            del merge
+            self._version += 1
+
+    def empty_like(self) -> GenomeMapping:
+        """
+        Return an empty mapping with the same features, contigs, alphabet,
+        cached features and hash function
+        """
+        return GenomeMapping(self._dtypes, self._contigs, self._bases[1:],
+                             self._cached, [], hash_function=self.hash_function)
+
+    def arrow_stream(self, size_t batch_size=65536) -> ArrowStream:
+        """
+        Export all loci and their features as a stream of Arrow record
+        batches with columns 'contig', 'pos', 'ref', 'alt' and a nullable
+        list column per feature (null marks an absent feature). The stream
+        reads the mapping lazily and fails if the mapping is modified before
+        it is exhausted. The export is not zero-copy: each batch owns its
+        buffers, filled from the stored records (numeric values with a
+        memcpy per feature and locus). A `requested_schema` is not
+        supported and raises NotImplementedError.
+        :param batch_size: the maximum number of rows per record batch
+        """
+        return ArrowStream(self, batch_size)
+
+    def __arrow_c_stream__(self, requested_schema=None):
+        return self.arrow_stream().__arrow_c_stream__(requested_schema)
+
+    cdef ArrowExport* exporter(self, size_t batch_size) except NULL:
+        cdef ArrowExport* exporter = new ArrowExport(
+            self.featurespecs, self._contigs, self._bases, &self.stringcache,
+            batch_size, &self._version)
+        exporter.describe(b'annogen.hash_function', self.hash_function)
+        if self._frozen:
+            exporter.attach(&self.frozentable)
+        else:
+            exporter.attach(&self.mapping)
+        return exporter
+
+    def freeze(self, str index='eytzinger', double gamma=2.0):
+        """
+        Convert the mapping into an immutable read-optimised layout. Frozen
+        mappings are faster to query and take less memory, but any further
+        insertion raises a RuntimeError. Freezing a frozen mapping is a no-op.
+        :param index: 'eytzinger' – binary search over sorted keys in
+        Eytzinger layout; 'mphf' – a minimal perfect hash over packed keys,
+        one hash evaluation and one key comparison per lookup;
+        :param gamma: MPHF space/speed trade-off: larger values build faster
+        and query faster, but take more bits per key (ignored by 'eytzinger')
+        """
+        if index not in FROZEN_INDICES:
+            raise ValueError(f'index must be one of {list(FROZEN_INDICES)}')
+        if not self._frozen:
+            self.frozentable.build(self.mapping, FROZEN_INDICES[index], gamma)
+            self._frozen = True
+            self._version += 1
+
+    @property
+    def frozen(self) -> bool:
+        return self._frozen
+
+    def build_filter(self, double fpr=0.01, capacity: Optional[int] = None):
+        """
+        Build a blocked Bloom filter over all stored loci. The filter is
+        checked before every table probe, so most lookups of absent loci are
+        resolved within a single cache line. Loci inserted later are added to
+        the filter, but the false-positive rate degrades once the number of
+        loci exceeds `capacity`.
+        :param fpr: the target false-positive rate
+        :param capacity: the number of loci to size the filter for; defaults
+        to the current number of loci
+        """
+        cdef:
+            LocusTable.iterator it
+            size_t i
+        self.filter.init(len(self) if capacity is None else capacity, fpr)
+        if self._frozen:
+            for i in range(self.frozentable.size()):
+                self.filter.insert(self.frozentable.key(i))
+        else:
+            it = self.mapping.begin()
+            while it != self.mapping.end():
+                self.filter.insert(deref(it).first.pack())
+                inc(it)
+
+    def drop_filter(self):
+        self.filter.clear()
+
+    @property
+    def has_filter(self) -> bool:
+        return self.filter.enabled()
+
+    def reserve(self, size_t size):
+        """
+        Resize the table to hold at least `size` loci without rehashing;
+        this invalidates views and Arrow exports in progress, since loci may
+        move
+        :param size: the number of loci
+        """
+        self.mapping.reserve(size)
+        self._version += 1
+
+    def set_resizing_parameters(self, float min_load_factor,
+                                float max_load_factor):
+        """
+        Set the load factors controlling when the table shrinks and grows.
+        Note: sparsepp clips `min_load_factor` to half of `max_load_factor`,
+        the Swiss table to a quarter. The table may be rehashed (right away
+        or on the next insertion), so views and Arrow exports in progress are
+        invalidated.
+        :param min_load_factor: shrink the table below this load factor; 0
+        disables shrinking
+        :param max_load_factor: grow the table above this load factor
+        """
+        if not 0 < max_load_factor <= 1:
+            raise ValueError('max_load_factor must be in (0, 1]')
+        if not 0 <= min_load_factor < max_load_factor:
+            raise ValueError('min_load_factor must be in [0, max_load_factor)')
+        self.mapping.set_resizing_parameters(min_load_factor, max_load_factor)
+        self._version += 1
+
+    @property
+    def hash_function(self) -> str:
+        return hasher_name(self.hasher())
+
+    def rehash(self, str hash_function):
+        """
+        Switch the table to another hash policy (see `__init__`), moving all
+        loci into a new table; this takes a while and twice the table's
+        memory for large mappings. Arrow exports record the policy as the
+        'annogen.hash_function' schema metadata.
+        :param hash_function: 'spp', 'mix', 'crc32c', 'wyhash' or 'xxh3'
+        """
+        if hash_function not in HASHERS:
+            raise ValueError(f'hash_function must be one of {list(HASHERS)}')
+        if self._frozen:
+            raise RuntimeError('cannot rehash a frozen mapping')
+        rehash_table(self.mapping, HASHERS[hash_function])
+        self._version += 1
+
+    @property
+    def load_factor(self) -> float:
+        return self.mapping.load_factor()
+
+    @property
+    def bucket_count(self) -> int:
+        return self.mapping.bucket_count()
+
+    @property
+    def table_backend(self) -> str:
+        """
+        The hash table implementation this build was compiled with:
+        'sparsepp' (compact, the default) or 'swiss' (faster lookups, more
+        memory; ANNOGEN_TABLE=swiss, see setup.py)
+        """
+        return TABLE_BACKEND
+
+    def __len__(self):
+        return self.frozentable.size() if self._frozen else self.mapping.size()
+
+    def stats(self) -> dict:
+        """
+        A snapshot of the mapping's hot-path statistics: counters of single
+        and batched lookups (hits, misses and Bloom filter rejects), inserts,
+        decoded records and values and string cache hits, and latency
+        summaries in nanoseconds (count, mean, min, max and percentiles with
+        ~6% precision) of single lookups, lookup batches, insert calls and
+        record decoding. Statistics are only collected in builds compiled
+        with ANNOGEN_STATS=1 (see setup.py); 'enabled' tells if this one was.
+        """
+        cdef MappingStats* stats = &self._stats
+        return {
+            'enabled': ANNOGEN_STATS,
+            'lookups': stats.lookups,
+            'hits': stats.hits,
+            'misses': stats.misses,
+            'filter_rejects': stats.filter_rejects,
+            'batches': stats.batches,
+            'batch_loci': stats.batch_loci,
+            'batch_hits': stats.batch_hits,
+            'inserts': stats.inserts,
+            'inserted': stats.inserted,
+            'decodes': stats.decodes,
+            'decoded_values': stats.decoded_values,
+            'cache_hits': stats.cache_hits,
+            'cache_misses': stats.cache_misses,
+            'lookup_latency': summarise(stats.lookup_latency),
+            'batch_latency': summarise(stats.batch_latency),
+            'insert_latency': summarise(stats.insert_latency),
+            'decode_latency': summarise(stats.decode_latency)
+        }
+
+    def reset_stats(self):
+        self._stats.clear()
+
+    def probe_stats(self) -> dict:
+        """
+        Probe statistics of the hash table, computed by replaying the probe
+        sequence of every key (so this takes a while for large mappings and
+        works in every build): the number of keys displaced from their home
+        bucket, keys sharing their full hash with another key, the mean and
+        maximum number of probes of a successful lookup, a histogram of
+        those ('probes': key counts by probe count) and the mean number of
+        probes of an unsuccessful lookup. Frozen mappings have no hash table.
+        With the Swiss table backend (see `table_backend`), which probes 16
+        slots at a time, buckets and probes are counted in groups of 16.
+        """
+        if self._frozen:
+            raise RuntimeError('frozen mappings have no hash table')
+        cdef ProbeStats stats = probe_stats(self.mapping)
+        return {'size': stats.size, 'buckets': stats.buckets,
+                'displaced': stats.displaced,
+                'hash_collisions': stats.hash_collisions,
+                'mean_probes': stats.mean_probes,
+                'max_probes': stats.max_probes,
+                'mean_miss_probes': stats.mean_miss_probes,
+                'probes': list(stats.probes)}
+
+    def hash_quality(self, hashers: Union[str, Iterable[str]] = tuple(HASHERS),
+                     double load_factor=0.5) -> dict:
+        """
+        Measure hash functions over the mapping's loci (frozen or not) on a
+        simulated table of the smallest power of two of buckets keeping the
+        load at or below `load_factor` (sparsepp grows at 0.5), to choose a
+        hash function for the data. For every function this reports:
+        - empty_buckets vs expected_empty (for a random function),
+        max_bucket_keys and uniformity: home bucket occupancy, uniformity is
+        1 for a random function and larger for clustered hashes;
+        - hash_collisions: keys sharing their full hash with another key;
+        - mean_probes, max_probes, probes (key counts by probe count) and
+        mean_miss_probes of successful and unsuccessful lookups;
+        - avalanche_mean, avalanche_bias, avalanche_worst: the probability
+        that flipping a key bit flips a hash bit (ideally 0.5), its mean and
+        worst deviation from 0.5 over sampled keys, and index_worst, the worst
+        deviation among the bucket index bits.
+        :param hashers: a function or functions out of 'spp' (the default,
+        std::hash<Locus>), 'mix', 'crc32c', 'wyhash' and 'xxh3'
+        :param load_factor: the load factor of the simulated table; at 1 the
+        table may be full, and a miss in a full table counts as probing every
+        bucket
+        :return: a dict of results by function
+        """
+        if isinstance(hashers, str):
+            hashers = [hashers]
+        unknown = set(hashers) - set(HASHERS)
+        if unknown:
+            raise ValueError(f'unknown hash functions {sorted(unknown)}; '
+                             f'expected some of {list(HASHERS)}')
+        cdef vector[uint64_t] keys = packed_keys(self.mapping, self.frozentable)
+        cdef HashQuality quality
+        results = {}
+        for name in hashers:
+            quality = hash_quality(keys, HASHERS[name], load_factor)
+            results[name] = {
+                'size': quality.size, 'buckets': quality.buckets,
+                'empty_buckets': quality.empty_buckets,
+                'expected_empty': quality.expected_empty,
+                'max_bucket_keys': quality.max_bucket_keys,
+                'uniformity': quality.uniformity,
+                'hash_collisions': quality.hash_collisions,
+                'mean_probes': quality.mean_probes,
+                'max_probes': quality.max_probes,
+                'mean_miss_probes': quality.mean_miss_probes,
+                'probes': list(quality.probes),
+                'avalanche_keys': quality.avalanche_keys,
+                'avalanche_mean': quality.avalanche_mean,
+                'avalanche_bias': quality.avalanche_bias,
+                'avalanche_worst': quality.avalanche_worst,
+                'index_worst': quality.index_worst
+            }
+        return results
+
+    def memory_usage(self) -> dict:
+        """
+        Break down the memory held by the mapping, in bytes:
+        - table_groups, table_slots, table_slack: group headers (control bytes
+        with the Swiss table backend), occupied slots (keys and record
+        handles) and unoccupied but allocated slots of the hash table;
+        - frozen_keys, frozen_records, frozen_index: the same for a frozen
+        mapping (the index is the minimal perfect hash, if any);
+        - record_blobs: records too large to be stored in their handles;
+        - record_garbage: blobs of deleted and overwritten records (see
+        `compact`); arena_slack: unused space of record chunks;
+        - string_cache_strings, string_cache_vector, string_cache_map: cached
+        string payloads and the containers indexing them;
+        - filter: the Bloom filter;
+        - allocator_overhead: malloc headers and rounding (glibc only);
+        - total: the sum of the above.
+        Also 'records' counts inline and spilled records, and 'features' maps
+        each feature to the number of loci having it, the number of values
+        and the bytes they take in records.
+        """
+        cdef:
+            MemoryUsage usage = memory_usage(
+                self.mapping, self.frozentable, self.arena, self.stringcache,
+                self.filter, self.featurespecs.size())
+            size_t code
+        breakdown = {
+            'table_groups': usage.table_groups,
+            'table_slots': usage.table_slots,
+            'table_slack': usage.table_slack,
+            'frozen_keys': usage.frozen_keys,
+            'frozen_records': usage.frozen_records,
+            'frozen_index': usage.frozen_index,
+            'record_blobs': usage.record_blobs,
+            'record_garbage': usage.record_garbage,
+            'arena_slack': usage.arena_slack,
+            'string_cache_strings': usage.string_cache_strings,
+            'string_cache_vector': usage.string_cache_vector,
+            'string_cache_map': usage.string_cache_map,
+            'filter': usage.filter,
+            'allocator_overhead': usage.allocator_overhead
+        }
+        breakdown['total'] = sum(breakdown.values())
+        breakdown['records'] = {'inline': usage.inline_records,
+                                'spilled': usage.spilled_records}
+        breakdown['features'] = {
+            self._features[code]: {'loci': usage.features[code].loci,
+                                   'values': usage.features[code].values,
+                                   'bytes': usage.features[code].bytes}
+            for code in range(usage.features.size())
+        }
+        return breakdown
 
-    cpdef dict getitem(self, str contig, int pos, str ref, str alt):
+    cpdef dict getitem(self, str contig, uint32_t pos, str ref, str alt,
+                       features=None):
+        """
+        Look up a locus
+        :param features: if not None, decode only these features
+        :return: a mapping from features to their values; empty if the locus
+        is absent
+        """
+        cdef:
+            int contig_code = self.ccode(contig, False)
+            int ref_code = self.bcode(ref, False)
+            int alt_code = self.bcode(alt, False)
+            const Records* records
+            FeatureMask mask
+            const FeatureMask* projection = NULL
+        if features is not None:
+            mask = self.projection(features)
+            projection = &mask
         # Return an empty dict if any of (contig, ref, alt) have not been
         # indexed
-        if (contig not in self._contig_ids or
-                    ref not in self._base_ids or alt not in self._base_ids):
+        if contig_code < 0 or ref_code < 0 or alt_code < 0:
             return {}
+        records = self.find(Locus(contig_code, pos, ref_code, alt_code))
+        if records == NULL:
+            return {}
+        return self.decode(deref(records), projection)
+
+    def getitems(self, positions: Iterable[Site],
+                 features: Optional[Iterable[str]] = None) -> List[dict]:
+        """
+        Look up a batch of loci; equivalent to calling `getitem` on each
+        position, but the table probes are pipelined so that their cache
+        misses overlap
+        :param positions: (contig, pos, ref, alt) tuples
+        :param features: if not None, decode only these features
+        """
         cdef:
-            uint8_t contig_code = self.ccode(contig)
-            char ref_code = self.bcode(ref)
-            char alt_code = self.bcode(alt)
-            Locus locus = Locus(contig_code, pos, ref_code, alt_code)
-            Records records = self.mapping[locus]
-        return self.decode(records)
+            LocusBatch batch
+            list encoded = []
+            FeatureMask mask
+            const FeatureMask* projection = NULL
+        if features is not None:
+            mask = self.projection(features)
+            projection = &mask
+        self.encode_positions(positions, batch, encoded)
+        return self.decode_batch(batch, encoded, projection)
+
+    def getview(self, str contig, uint32_t pos, str ref, str alt,
+                features: Optional[Iterable[str]] = None
+                ) -> Optional[RecordView]:
+        """
+        Look up a locus like `getitem`, but return a `RecordView` that decodes
+        features on access, or None if the locus is absent
+        :param features: if not None, the view only shows these features
+        """
+        cdef:
+            int contig_code = self.ccode(contig, False)
+            int ref_code = self.bcode(ref, False)
+            int alt_code = self.bcode(alt, False)
+            const Records* records
+            FeatureMask mask
+            const FeatureMask* projection = NULL
+        if features is not None:
+            mask = self.projection(features)
+            projection = &mask
+        if contig_code < 0 or ref_code < 0 or alt_code < 0:
+            return None
+        records = self.find(Locus(contig_code, pos, ref_code, alt_code))
+        if records == NULL:
+            return None
+        return RecordView.wrap(self, records, projection)
+
+    def getviews(self, positions: Iterable[Site],
+                 features: Optional[Iterable[str]] = None
+                 ) -> List[Optional[RecordView]]:
+        """
+        Look up a batch of loci like `getitems`, but return `RecordView`s
+        (None for absent loci)
+        :param positions: (contig, pos, ref, alt) tuples
+        :param features: if not None, the views only show these features
+        """
+        cdef:
+            LocusBatch batch
+            list encoded = []
+            FeatureMask mask
+            const FeatureMask* projection = NULL
+        if features is not None:
+            mask = self.projection(features)
+            projection = &mask
+        self.encode_positions(positions, batch, encoded)
+        return self.decode_batch(batch, encoded, projection, True)
+
+    cdef void encode_positions(self, positions, LocusBatch& batch,
+                               list encoded) except *:
+        # Append encoded positions to `batch`; `encoded` tells which
+        # positions made it into the batch
+        cdef int contig_code, ref_code, alt_code
+        for contig, pos, ref, alt in positions:
+            # positions with unknown contigs or bases are not indexed
+            contig_code = self.ccode(contig, False)
+            ref_code = self.bcode(ref, False)
+            alt_code = self.bcode(alt, False)
+            if contig_code < 0 or ref_code < 0 or alt_code < 0:
+                encoded.append(False)
+            else:
+                batch.push_back(contig_code, pos, ref_code, alt_code)
+                encoded.append(True)
 
-    def getitems(self, positions: Iterable):
-        return [self.getitem(*position) for position in positions]
+    def getitems_arrays(self, contigs, positions, refs, alts,
+                        features: Optional[Iterable[str]] = None
+                        ) -> List[dict]:
+        """
+        Look up a batch of loci given as columns; equivalent to `getitems`,
+        but contigs and alleles are translated natively straight from raw
+        bytes, without creating any Python objects per locus
+        :param contigs: a C-contiguous buffer of fixed-width NUL-padded byte
+        strings, e.g. a NumPy array of dtype 'S'
+        :param positions: a sequence of positions; a buffer of uint32 is used
+        as is, anything else is converted
+        :param refs: same as `contigs`
+        :param alts: same as `contigs`
+        :param features: if not None, decode only these features
+        """
+        cdef:
+            LocusBatch batch
+            FeatureMask mask
+            const FeatureMask* projection = NULL
+        if features is not None:
+            mask = self.projection(features)
+            projection = &mask
+        encoded = self.encode_arrays(contigs, positions, refs, alts, batch)
+        return self.decode_batch(batch, encoded, projection)
+
+    cdef list encode_arrays(self, contigs, positions, refs, alts,
+                            LocusBatch& batch):
+        # Append encoded columns to `batch`; return a list telling which
+        # positions made it into the batch
+        cdef:
+            vector[int16_t] contig_codes = self.encode_column(
+                contigs, &self.contigcoder, NULL)
+            vector[int16_t] ref_codes = self.encode_column(
+                refs, NULL, &self.basecoder)
+            vector[int16_t] alt_codes = self.encode_column(
+                alts, NULL, &self.basecoder)
+            const uint32_t[::1] pos
+            list encoded
+            size_t i, n = contig_codes.size()
+        try:
+            pos = positions
+        except (ValueError, TypeError):
+            pos = array('I', positions)
+        if not n == pos.shape[0] == ref_codes.size() == alt_codes.size():
+            raise ValueError('all columns must have the same length')
+        encoded = [False] * n
+        for i in range(n):
+            if contig_codes[i] >= 0 and ref_codes[i] >= 0 and alt_codes[i] >= 0:
+                batch.push_back(contig_codes[i], pos[i], ref_codes[i],
+                                alt_codes[i])
+                encoded[i] = True
+        return encoded
+
+    cdef vector[int16_t] encode_column(self, object column,
+                                       ContigCoder* contigcoder,
+                                       BaseCoder* basecoder) except *:
+        # Translate a buffer of fixed-width byte strings with either coder
+        cdef:
+            Py_buffer view
+            vector[int16_t] codes
+            size_t n
+        PyObject_GetBuffer(column, &view, PyBUF_C_CONTIGUOUS | PyBUF_FORMAT)
+        try:
+            if view.ndim != 1 or not (<bytes>view.format).endswith(b's'):
+                raise TypeError('expected a 1D array of fixed-width byte '
+                                'strings')
+            n = view.shape[0]
+            codes.resize(n)
+            if contigcoder != NULL:
+                contigcoder.encode_fixed(<const char*>view.buf, view.itemsize,
+                                         n, codes.data())
+            else:
+                basecoder.encode_fixed(<const char*>view.buf, view.itemsize,
+                                       n, codes.data())
+        finally:
+            PyBuffer_Release(&view)
+        return codes
+
+    cdef list decode_batch(self, LocusBatch& batch, list encoded,
+                           const FeatureMask* projection=NULL,
+                           cbool views=False):
+        # Look up the loci in `batch` and decode the results (or wrap them in
+        # views); `encoded` tells which positions of the original batch made
+        # it into `batch`; see `decode` for `projection`
+        cdef:
+            vector[const Records*] found
+            list decoded = []
+            size_t i = 0
+        found.resize(batch.size())
+        self.find_batch(batch, found.data())
+        for is_encoded in encoded:
+            if is_encoded and found[i] != NULL:
+                decoded.append(RecordView.wrap(self, found[i], projection)
+                               if views else
+                               self.decode(deref(found[i]), projection))
+            else:
+                decoded.append(None if views else {})
+            i += is_encoded
+        return decoded
+
+    cdef inline const Records* find(self, const Locus& locus):
+        cdef:
+            uint64_t start = stats_clock()
+            const Records* found = NULL
+            cbool filtered = not self.filter.contains(locus.pack())
+        if not filtered:
+            found = (self.frozentable.find(locus) if self._frozen else
+                     lookup(self.mapping, locus))
+        self._stats.lookup(start, found, filtered)
+        return found
+
+    cdef inline LocusHasher hasher(self):
+        return self.mapping.hash_function().hasher()
+
+    cdef inline void find_batch(self, LocusBatch& batch, const Records** out):
+        # frozen tables only need the packed keys
+        batch.pack(not self._frozen, self.hasher())
+        self.find_packed(batch, out)
+
+    cdef void find_packed_over(self, LocusBatch& batch,
+                               const Records** out, size_t* owners,
+                               size_t owner):
+        # Look up a packed and hashed batch, overwriting `out` (and setting
+        # `owners` to `owner`) wherever the locus is found
+        cdef:
+            vector[const Records*] found
+            size_t i
+        found.resize(batch.size())
+        self.find_packed(batch, found.data())
+        for i in range(batch.size()):
+            if found[i] != NULL:
+                out[i] = found[i]
+                owners[i] = owner
+
+    cdef inline void find_packed(self, LocusBatch& batch,
+                                 const Records** out):
+        # Same as `find_batch` for a batch that is already packed; mutable
+        # tables hash it with their policy unless it already is
+        cdef uint64_t start = stats_clock()
+        if self._frozen:
+            lookup_batch(self.frozentable, self.filter, batch.keys.data(),
+                         batch.size(), out)
+        else:
+            batch.hash(self.hasher())
+            lookup_batch(self.mapping, self.filter, batch.keys.data(),
+                         batch.hashes.data(), batch.size(), out)
+        self._stats.batch(start, out, batch.size())
 
     cdef inline int fcode(self, str feature):
         """
@@ -181,28 +1767,40 @@ cdef class GenomeMapping:
     cdef inline str feature(self, int feature_code):
         return self._features[feature_code]
 
-    cdef inline int ccode(self, str contig):
+    cdef inline int ccode(self, str contig, cbool strict=True) except? -2:
         """
-        Return a feature code
+        Return a contig code
         :param contig: 
+        :param strict: raise a KeyError for unknown contigs instead of
+        returning -1
         :return: 
         """
-        if contig not in self._contig_ids:
+        cdef:
+            Py_ssize_t size
+            const char* data = PyUnicode_AsUTF8AndSize(contig, &size)
+            int code = self.contigcoder.encode(data, size)
+        if code < 0 and strict:
             raise KeyError(f'encountered unknown contig "{contig}"')
-        return self._contig_ids[contig]
+        return code
 
     cdef inline str contig(self, int contig_code):
         return self._contigs[contig_code]
 
-    cdef inline int bcode(self, str base):
+    cdef inline int bcode(self, str base, cbool strict=True) except? -2:
         """
         Return a base code
         :param base: 
+        :param strict: raise a KeyError for unknown bases instead of
+        returning -1
         :return: 
         """
-        if base not in self._base_ids:
-            raise KeyError(f'encountered unknown feature "{base}"')
-        return self._base_ids[base]
+        cdef:
+            Py_ssize_t size
+            const char* data = PyUnicode_AsUTF8AndSize(base, &size)
+            int code = self.basecoder.encode(data, size)
+        if code < 0 and strict:
+            raise KeyError(f'encountered unknown base "{base}"')
+        return code
 
     cdef inline str base(self, int base_code):
         return self._bases[base_code]
@@ -219,65 +1817,92 @@ cdef class GenomeMapping:
     def contigs(self):
         return self._contigs
 
-    cdef dict decode(self, Records records):
-        cdef:
-            vector[pair[uint8_t, vector[string]]] stringrecs = records.strings
-            vector[pair[uint8_t, vector[float]]] floatrecs = records.floats
-            vector[pair[uint8_t, vector[int32_t]]] intrecs = records.integers
-            list float_features = [
-                (self.feature(code), values) for code, values in floatrecs
-            ]
-            # exclude cached strings from intrecs
-            list int_features = [
-                (self.feature(code), values)
-                for code, values in intrecs
-                if self.feature(code) not in self._cached
-            ]
-            # include cached strings from intrecs
-            list string_features = [
-                (self.feature(code), self.frombytes(values))
-                for code, values in stringrecs
-            ] + [
-                (self.feature(code), self.fromcache(values))
-                for code, values in intrecs
-                if self.feature(code) in self._cached
-            ]
-            dict decoded = {
-                feature: values for feature, values in
-                float_features + int_features + string_features
-            }
+    cdef dict decode(self, const Records& records,
+                     const FeatureMask* projection=NULL):
+        # Decode the features in `projection` (all if NULL); records of other
+        # features are skipped without creating any Python objects
+        cdef:
+            uint64_t start = stats_clock()
+            dict decoded = {}
+            RecordsReader reader = RecordsReader(records)
+            size_t nvalues = 0
+        while reader.next():
+            if projection == NULL or projection.test(reader.code):
+                decoded[self.feature(reader.code)] = self.values(reader)
+                nvalues += reader.count
+        self._stats.decode(start, nvalues)
         return decoded
 
-    cdef Records encode(self, dict annotations):
-        # separate values by type and cast to either int, str or float
-        cdef:
-            list strings = [
-                (self.fcode(f), self.tobytes(values))
-                for f, values in annotations.items()
-                if self._dtypes[f] is str and f not in self._cached
-            ]
-            list cached = [
-                (self.fcode(f), self.tocache(values))
-                for f, values in annotations.items()
-                if self._dtypes[f] is str and f in self._cached
-            ]
-            list floats = [
-                (self.fcode(f), self.cast(float, values))
-                for f, values in annotations.items()
-                if self._dtypes[f] is float
-            ]
-            # integer records include cached string records
-            list ints = [
-                (self.fcode(f), self.cast(int, values))
-                for f, values in annotations.items()
-                if self._dtypes[f] is int
-            ] + cached
-
-            vector[pair[uint8_t, vector[string]]] stringrecs = strings
-            vector[pair[uint8_t, vector[float]]] floatrecs = floats
-            vector[pair[uint8_t, vector[int32_t]]] intrecs = ints
-
-        return Records(stringrecs, floatrecs, intrecs)
+    cdef list values(self, RecordsReader& reader):
+        # Decode the values of the reader's current feature
+        cdef:
+            list values = []
+            uint32_t i
+        if reader.is_string:
+            for i in range(reader.count):
+                reader.read_string()
+                values.append(PyUnicode_DecodeUTF8(
+                    reader.string_data, reader.string_size, NULL))
+        elif self.float_mask.test(reader.code):
+            for i in range(reader.count):
+                values.append(reader.number(i))
+        elif self.cached_mask.test(reader.code):
+            for i in range(reader.count):
+                values.append(self.stringcache.cache(reader.integer(i)))
+        else:
+            for i in range(reader.count):
+                values.append(reader.integer(i))
+        return values
+
+    cdef FeatureMask projection(self, features) except *:
+        # Resolve a feature projection into a mask of feature codes
+        cdef FeatureMask mask
+        if isinstance(features, str):
+            raise TypeError('`features` must be an iterable of feature names')
+        for feature in features:
+            mask.set(self.fcode(feature))
+        return mask
+
+    cdef object decode_feature(self, const Records& records, int code):
+        # Decode the values of a single feature; None if the feature is absent
+        cdef RecordsReader reader = RecordsReader(records)
+        if reader.find(code):
+            return self.values(reader)
+        return None
+
+    cdef Records encode(self, dict annotations,
+                        RecordArena* arena=NULL) except *:
+        # cast values to either int, str or float and serialise them into a
+        # record blob allocated from `arena` (the mapping's arena if NULL)
+        try:
+            for f, values in annotations.items():
+                self.encode_feature(f, values)
+        except:
+            self.builder.clear()
+            raise
+        if arena == NULL:
+            return self.builder.finish(self.arena)
+        return self.builder.finish(deref(arena))
+
+    cdef void encode_feature(self, str f, list values) except *:
+        # add the values of a feature to the builder
+        cdef:
+            int code = self.fcode(f)
+            bytes value
+        if self._dtypes[f] is str and f not in self._cached:
+            self.builder.begin(code, True)
+            for value in self.tobytes(values):
+                self.builder.add_string(value, len(value))
+            return
+        # cached strings are stored as integer codes
+        self.builder.begin(code, False)
+        if self._dtypes[f] is float:
+            for number in self.cast(float, values):
+                self.builder.add_float(number)
+        else:
+            for number in (self.tocache(values) if f in self._cached
+                           else self.cast(int, values)):
+                self.builder.add_integer(number)
 
     cdef list tocache(self, list strings):
         """
@@ -288,29 +1913,340 @@ cdef class GenomeMapping:
         cdef:
             list cached = []
             string s
+            size_t size = self.stringcache.size()
         for s in self.tobytes(self.cast(str, strings)):
             cached.append(self.stringcache.cache(s))
+        self._stats.cache(len(cached), self.stringcache.size() - size)
         return cached
 
-    cdef list fromcache(self, list cached_strings):
-        cdef:
-            list uncached = []
-            int cached
-        for cached in cached_strings:
-            uncached.append(self.stringcache.cache(cached))
-        return self.frombytes(uncached)
-
     cdef inline list tobytes(self, list unicode_strings):
         return [s.encode() if not isinstance(s, bytes) else s
                 for s in unicode_strings]
 
-    cdef inline list frombytes(self, list byte_stings):
-        return [s.decode() if isinstance(s, bytes) else s
-                for s in byte_stings]
-
     cdef inline list cast(self, type constructor, list values):
         return [constructor(val) for val in values]
 
+cdef class MappingSet:
+    """
+    Several GenomeMappings (e.g. one per annotation source) queried together.
+    All mappings must share contigs and alphabet, so each locus is encoded
+    and packed once per batch, hashed once per hash function among the
+    mutable mappings (frozen ones need no hash), and probed in every mapping.
+    """
+
+    cdef:
+        list _names
+        list _mappings
+        GenomeMapping coder     # encodes queries for all mappings
+
+    def __init__(self, mappings: Mapping[str, GenomeMapping]):
+        """
+        :param mappings: a mapping from source names to GenomeMappings
+        """
+        self._names = list(mappings)
+        self._mappings = list(mappings.values())
+        if not self._mappings:
+            raise ValueError('a MappingSet needs at least one mapping')
+        if not all(isinstance(mapping, GenomeMapping)
+                   for mapping in self._mappings):
+            raise TypeError('expected GenomeMapping instances')
+        self.coder = self._mappings[0]
+        for mapping in self._mappings[1:]:
+            if (mapping.contigs != self.coder.contigs or
+                    mapping.bases != self.coder.bases):
+                raise ValueError('all mappings must have the same contigs '
+                                 'and alphabet')
+
+    @property
+    def names(self) -> List[str]:
+        return self._names
+
+    def __getitem__(self, str name) -> GenomeMapping:
+        return self._mappings[self._names.index(name)]
+
+    def __len__(self):
+        return len(self._mappings)
+
+    def getitems(self, positions: Iterable[Site],
+                 features: Optional[Mapping[str, Iterable[str]]] = None
+                 ) -> List[Dict[str, dict]]:
+        """
+        Look up a batch of loci in all mappings
+        :param positions: (contig, pos, ref, alt) tuples
+        :param features: optional projections: a mapping from source names to
+        the features to decode from that source
+        :return: a dict per position mapping the names of sources containing
+        the locus to its annotations
+        """
+        cdef:
+            LocusBatch batch
+            list encoded = []
+        self.coder.encode_positions(positions, batch, encoded)
+        return self.lookup(batch, encoded, features)
+
+    def getitems_arrays(self, contigs, positions, refs, alts,
+                        features: Optional[Mapping[str, Iterable[str]]] = None
+                        ) -> List[Dict[str, dict]]:
+        """
+        Same as `getitems`, but positions are given as columns, as in
+        `GenomeMapping.getitems_arrays`
+        """
+        cdef LocusBatch batch
+        encoded = self.coder.encode_arrays(contigs, positions, refs, alts,
+                                           batch)
+        return self.lookup(batch, encoded, features)
+
+    cdef list lookup(self, LocusBatch& batch, list encoded, features):
+        cdef:
+            size_t nloci = batch.size()
+            size_t nsources = len(self._mappings)
+            size_t i = 0, j
+            vector[const Records*] found
+            vector[FeatureMask] masks
+            vector[cbool] projected
+            GenomeMapping mapping
+            dict merged
+            list results = []
+        features = dict(features or {})
+        if any(name not in self._names for name in features):
+            raise KeyError('`features` refers to unknown sources')
+        masks.resize(nsources)
+        projected.resize(nsources)
+        for j in range(nsources):
+            name = self._names[j]
+            if name in features:
+                masks[j] = (<GenomeMapping>self._mappings[j]).projection(
+                    features[name])
+                projected[j] = True
+        # compute the keys once, and the hashes once per hash policy: probe
+        # the frozen tables first, then the mutable ones grouped by policy,
+        # so that the batch is only rehashed when the policy changes (the
+        # first policy is hashed while packing)
+        order = sorted(range(nsources), key=lambda j: (
+            not self._mappings[j].frozen, self._mappings[j].hash_function))
+        mutable = [j for j in order if not self._mappings[j].frozen]
+        batch.pack(bool(mutable), (<GenomeMapping>self._mappings[mutable[0]])
+                   .hasher() if mutable else SPP_HASH)
+        found.resize(nloci * nsources)
+        for j in order:
+            mapping = self._mappings[j]
+            mapping.find_packed(batch, found.data() + j * nloci)
+        for is_encoded in encoded:
+            merged = {}
+            if is_encoded:
+                for j in range(nsources):
+                    if found[j * nloci + i] != NULL:
+                        mapping = self._mappings[j]
+                        merged[self._names[j]] = mapping.decode(
+                            deref(found[j * nloci + i]),
+                            &masks[j] if projected[j] else NULL)
+            i += is_encoded
+            results.append(merged)
+        return results
+
+
+cdef class LayeredMapping:
+    """
+    An immutable (frozen) base mapping overlaid by small mutable delta
+    layers, e.g. a monthly release plus weekly updates. Insertions and
+    deletions go to the newest layer; a deletion leaves a tombstone that
+    hides the locus in all older layers and the base. Lookups check the
+    layers from the newest to the oldest, then the base; a locus found in a
+    layer replaces the older versions as a whole. `compact` folds the layers
+    into a new base.
+    """
+
+    cdef:
+        GenomeMapping _base
+        list layers                 # GenomeMappings, the newest last
+        vector[KeySet] tombstones   # deleted packed keys of each layer
+
+    def __init__(self, GenomeMapping base):
+        """
+        :param base: a frozen mapping
+        """
+        if not base.frozen:
+            raise ValueError('the base mapping must be frozen')
+        self._base = base
+        self.layers = []
+
+    @property
+    def base(self) -> GenomeMapping:
+        return self._base
+
+    @property
+    def depth(self) -> int:
+        # the number of delta layers
+        return len(self.layers)
+
+    def add_layer(self):
+        """
+        Start a new delta layer; subsequent changes go there
+        """
+        self.layers.append(self._base.empty_like())
+        self.tombstones.push_back(KeySet())
+
+    cdef GenomeMapping top(self):
+        if not self.layers:
+            self.add_layer()
+        return self.layers[-1]
+
+    def insert(self, str contig, uint32_t pos, str ref, str alt, dict annotations):
+        cdef GenomeMapping top = self.top()
+        top.insert(contig, pos, ref, alt, annotations)
+        self.tombstones.back().erase(self.key(contig, pos, ref, alt))
+
+    def insert_many(self, entries: Iterable[Tuple[Site, Dict[str, List]]]):
+        entries = list(entries)
+        cdef GenomeMapping top = self.top()
+        top.insert_many(entries)
+        for (contig, pos, ref, alt), _ in entries:
+            self.tombstones.back().erase(self.key(contig, pos, ref, alt))
+
+    def delete(self, str contig, uint32_t pos, str ref, str alt) -> bool:
+        """
+        Delete a locus from the layered view; the base is left unchanged. The
+        newest layer drops its own version of the locus and records a
+        tombstone if an older layer or the base still holds one
+        :return: False if the locus was absent from the view
+        """
+        cdef:
+            GenomeMapping top = self.top()
+            int contig_code = self._base.ccode(contig, False)
+            int ref_code = self._base.bcode(ref, False)
+            int alt_code = self._base.bcode(alt, False)
+            Locus locus
+            cbool erased, hidden, below
+        erased = top.delete(contig, pos, ref, alt)
+        if contig_code < 0 or ref_code < 0 or alt_code < 0:
+            return False
+        locus = Locus(contig_code, pos, ref_code, alt_code)
+        hidden = self.tombstones.back().count(locus.pack()) > 0
+        below = self.holds(locus, len(self.layers) - 1)
+        if below:
+            self.tombstones.back().insert(locus.pack())
+        return erased or (below and not hidden)
+
+    cdef cbool holds(self, const Locus& locus, size_t nlayers):
+        # Whether the oldest `nlayers` layers and the base show `locus`
+        cdef:
+            GenomeMapping layer
+            size_t j
+        for j in reversed(range(nlayers)):
+            if self.tombstones[j].count(locus.pack()):
+                return False
+            layer = self.layers[j]
+            if layer.find(locus) != NULL:
+                return True
+        return self._base.find(locus) != NULL
+
+    cdef uint64_t key(self, str contig, uint32_t pos, str ref, str alt) except? 0:
+        return Locus(self._base.ccode(contig), pos, self._base.bcode(ref),
+                     self._base.bcode(alt)).pack()
+
+    def getitem(self, str contig, uint32_t pos, str ref, str alt,
+                features=None) -> dict:
+        """
+        Look up a locus; see `GenomeMapping.getitem`
+        """
+        cdef:
+            int contig_code = self._base.ccode(contig, False)
+            int ref_code = self._base.bcode(ref, False)
+            int alt_code = self._base.bcode(alt, False)
+            Locus locus
+            GenomeMapping layer
+            const Records* records = NULL
+            FeatureMask mask
+            const FeatureMask* projection = NULL
+            size_t j
+        if features is not None:
+            mask = self._base.projection(features)
+            projection = &mask
+        if contig_code < 0 or ref_code < 0 or alt_code < 0:
+            return {}
+        locus = Locus(contig_code, pos, ref_code, alt_code)
+        for j in reversed(range(len(self.layers))):
+            if self.tombstones[j].count(locus.pack()):
+                return {}
+            layer = self.layers[j]
+            records = layer.find(locus)
+            if records != NULL:
+                return layer.decode(deref(records), projection)
+        records = self._base.find(locus)
+        return {} if records == NULL else self._base.decode(deref(records),
+                                                            projection)
+
+    def getitems(self, positions: Iterable[Site],
+                 features: Optional[Iterable[str]] = None) -> List[dict]:
+        """
+        Look up a batch of loci; keys and hashes are computed once for all
+        layers and the base
+        """
+        cdef:
+            LocusBatch batch
+            list encoded = []
+            list decoded = []
+            vector[const Records*] found
+            vector[size_t] owners       # the layer deciding each locus
+            FeatureMask mask
+            const FeatureMask* projection = NULL
+            size_t nlayers = len(self.layers)
+            size_t nloci, i, j, k = 0
+            GenomeMapping layer
+        if features is not None:
+            mask = self._base.projection(features)
+            projection = &mask
+        self._base.encode_positions(positions, batch, encoded)
+        nloci = batch.size()
+        # layers share the base's hash policy (see `empty_like`)
+        batch.pack(True, self._base.hasher())
+        found.resize(nloci)
+        owners.resize(nloci, nlayers)   # nlayers stands for the base
+        self._base.find_packed(batch, found.data())
+        # newer layers override older ones
+        for j in range(nlayers):
+            layer = self.layers[j]
+            for i in range(nloci):
+                if self.tombstones[j].count(batch.keys[i]):
+                    found[i] = NULL
+                    owners[i] = j
+            layer.find_packed_over(batch, found.data(), owners.data(), j)
+        for is_encoded in encoded:
+            if is_encoded and found[k] != NULL:
+                layer = (self._base if owners[k] == nlayers else
+                         self.layers[owners[k]])
+                decoded.append(layer.decode(deref(found[k]), projection))
+            else:
+                decoded.append({})
+            k += is_encoded
+        return decoded
+
+    def compact(self, str index='eytzinger', double gamma=2.0,
+                filter_fpr: Optional[float] = None):
+        """
+        Fold all layers into a new frozen base and drop them
+        :param index: see `GenomeMapping.freeze`
+        :param gamma: see `GenomeMapping.freeze`
+        :param filter_fpr: if not None, build a Bloom filter over the new base
+        """
+        cdef:
+            GenomeMapping base = self._base.empty_like()
+            GenomeMapping layer
+            size_t j
+        base.reserve(len(self._base))
+        base.merge(self._base, 'replace')
+        for j in range(len(self.layers)):
+            layer = self.layers[j]
+            erase_keys(base.mapping, self.tombstones[j])
+            base.merge(layer, 'replace')
+        base.freeze(index, gamma)
+        if filter_fpr is not None:
+            base.build_filter(filter_fpr)
+        self._base = base
+        self.layers = []
+        self.tombstones.clear()
+
+
 # TODO add explicit type conversion
 # TODO add annotation for entry type
 # TODO improve docs
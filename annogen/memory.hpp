@@ -0,0 +1,251 @@
+#ifndef memory_h
+#define memory_h
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "sparsepp/spp.h"
+#include "swiss.hpp"
+#include "mapping.hpp"
+#include "records.hpp"
+#include "filter.hpp"
+#include "frozen.hpp"
+
+
+// Memory accounting. Sizes are computed from the data structures themselves
+// rather than sampled from the allocator, so they are exact up to allocator
+// overhead, which is only known (and reported) with glibc.
+
+
+struct FeatureMemory {
+    // Space taken by a feature in record blobs
+    size_t loci;        // loci having the feature
+    size_t values;
+    size_t bytes;       // headers and values
+
+    FeatureMemory(): loci(0), values(0), bytes(0) {}
+};
+
+
+struct MemoryUsage {
+    size_t table_groups;        // group headers (control bytes) of the LocusTable
+    size_t table_slots;         // occupied slots: keys and Records handles
+    size_t table_slack;         // allocated but unoccupied slots
+    size_t frozen_keys;
+    size_t frozen_records;      // Records handles of a frozen table
+    size_t frozen_index;        // the minimal perfect hash, if any
+    size_t inline_records;      // number of records stored in their handles
+    size_t spilled_records;     // number of records stored in the arena
+    size_t record_blobs;        // live blobs in the arena
+    size_t record_garbage;      // blobs of deleted and overwritten records
+    size_t arena_slack;         // unused tails of arena chunks
+    size_t string_cache_strings;    // string payloads outside std::string
+    size_t string_cache_vector;     // the vector of cached strings
+    size_t string_cache_map;        // the string-to-code map
+    size_t filter;
+    size_t allocator_overhead;  // malloc headers and rounding (glibc only)
+    std::vector<FeatureMemory> features;    // by feature code
+
+    MemoryUsage():
+        table_groups(0), table_slots(0), table_slack(0), frozen_keys(0),
+        frozen_records(0), frozen_index(0), inline_records(0),
+        spilled_records(0), record_blobs(0), record_garbage(0), arena_slack(0),
+        string_cache_strings(0), string_cache_vector(0), string_cache_map(0),
+        filter(0), allocator_overhead(0) {}
+};
+
+
+inline size_t malloc_overhead(const void* block, size_t requested) {
+    // Bytes the allocator spends on a block beyond the requested size
+#ifdef __GLIBC__
+    return block ? malloc_usable_size(const_cast<void*>(block)) + sizeof(size_t) - requested : 0;
+#else
+    return 0;
+#endif
+}
+
+
+inline size_t string_heap(const std::string& value, size_t& overhead) {
+    // Heap bytes of a string's payload (none for short strings stored inline)
+    const char* data = value.data();
+    const char* self = (const char*)&value;
+    if (data >= self && data < self + sizeof(value)) {
+        return 0;
+    }
+    overhead += malloc_overhead(data, value.capacity() + 1);
+    return value.capacity() + 1;
+}
+
+
+inline uint32_t group_capacity(uint32_t n) {
+    // Slots allocated by sparsepp for a group of `n` items; mirrors
+    // sparsegroup::_sizing with the default SPP_ALLOC_SZ
+#if !defined(SPP_ALLOC_SZ) || (SPP_ALLOC_SZ == 0)
+    static const struct Capacities {
+        uint8_t data[SPP_GROUP_SIZE];
+        Capacities() {
+            uint8_t group_sz = SPP_GROUP_SIZE / 4;
+            uint8_t start = SPP_GROUP_SIZE / 8;
+            uint8_t size = start;
+            for (int i = 0; i < 4; ++i) {
+                for (int j = 0; j < group_sz; ++j) {
+                    if (j && j % start == 0) {
+                        size += start;
+                    }
+                    data[i * group_sz + j] = size;
+                }
+                if (start > 2) {
+                    start /= 2;
+                }
+                size += start;
+            }
+        }
+    } capacities;
+    return n ? capacities.data[n - 1] : 0;
+#elif (SPP_ALLOC_SZ == 1)
+    return n;
+#else
+    return (n + SPP_ALLOC_SZ - 1) & ~(uint32_t)(SPP_ALLOC_SZ - 1);
+#endif
+}
+
+
+template <class Table, class Visit>
+void table_memory(const Table& table, size_t& groups, size_t& slots,
+                  size_t& slack, size_t& overhead, Visit visit) {
+    // Account for a sparse_hash_map: one header per group of SPP_GROUP_SIZE
+    // buckets plus a slot array per non-empty group; `visit` is called on
+    // every item
+    typedef typename Table::value_type Item;
+    groups += (table.bucket_count() / SPP_GROUP_SIZE + 1) *
+              sizeof(*table.begin().row_current);
+    for (typename Table::const_iterator it = table.begin(); it != table.end(); ) {
+        const decltype(it.row_current) row = it.row_current;
+        const uint32_t items = (uint32_t)row->num_nonempty();
+        const size_t allocated = group_capacity(items) * sizeof(Item);
+        slots += items * sizeof(Item);
+        slack += allocated - items * sizeof(Item);
+        overhead += malloc_overhead(&*it, allocated);
+        for (; it != table.end() && it.row_current == row; ++it) {
+            visit(*it);
+        }
+    }
+}
+
+
+template <class Key, class Value, class Hasher, class Visit>
+void table_memory(const swiss::SwissTable<Key, Value, Hasher>& table,
+                  size_t& groups, size_t& slots, size_t& slack,
+                  size_t& overhead, Visit visit) {
+    // Account for a Swiss table: `groups` gets the control bytes, and all
+    // slots are allocated up front in the same block
+    typedef typename swiss::SwissTable<Key, Value, Hasher>::value_type Item;
+    groups += table.control_bytes();
+    slots += table.size() * sizeof(Item);
+    slack += table.allocated_bytes() - table.control_bytes() - table.size() * sizeof(Item);
+    overhead += malloc_overhead(table.allocation(), table.allocated_bytes());
+    for (auto it = table.begin(); it != table.end(); ++it) {
+        visit(*it);
+    }
+}
+
+
+class MemoryAccounting {
+    // Walks a mapping's structures and fills a MemoryUsage
+
+private:
+
+    MemoryUsage& usage;
+
+    void records(const Records& records) {
+        if (!records) {
+            return;
+        }
+        if (records.is_inline()) {
+            ++usage.inline_records;
+        } else {
+            ++usage.spilled_records;
+            usage.record_blobs += records.size();
+        }
+        RecordsReader reader(records);
+        while (reader.next()) {
+            FeatureMemory& feature = usage.features[reader.code];
+            ++feature.loci;
+            feature.values += reader.count;
+            feature.bytes += varint_size((uint64_t)reader.count << 1 | reader.is_string) +
+                             (reader.is_string ? reader.string_bytes() : 4 * reader.count);
+        }
+    }
+
+public:
+
+    explicit MemoryAccounting(MemoryUsage& usage): usage(usage) {}
+
+    void table(const LocusTable& table) {
+        table_memory(table, usage.table_groups, usage.table_slots,
+                     usage.table_slack, usage.allocator_overhead,
+                     [this](const LocusTable::value_type& item) {
+                         records(item.second);
+                     });
+    }
+
+    void frozen(const FrozenTable& table) {
+        usage.frozen_keys += (table.size() + 1) * sizeof(uint64_t);
+        usage.frozen_records += (table.size() + 1) * sizeof(Records);
+        usage.frozen_index += table.index_bytes();
+        for (size_t i = 0; i < table.size(); ++i) {
+            records(table.record(i));
+        }
+    }
+
+    void arena(const RecordArena& arena) {
+        // call after the tables: blobs not reached from them are garbage
+        usage.record_garbage += arena.used() - usage.record_blobs;
+        usage.arena_slack += arena.bytes() - arena.used();
+    }
+
+    void cache(const StringCache& cache) {
+        const std::vector<std::string>& strings = cache.cache();
+        usage.string_cache_vector += strings.capacity() * sizeof(std::string);
+        usage.allocator_overhead += malloc_overhead(
+            strings.data(), strings.capacity() * sizeof(std::string));
+        for (size_t i = 0; i < strings.size(); ++i) {
+            usage.string_cache_strings += string_heap(strings[i], usage.allocator_overhead);
+        }
+        size_t slack = 0;
+        size_t keys = 0;
+        size_t& overhead = usage.allocator_overhead;
+        table_memory(cache.map(), usage.string_cache_map, usage.string_cache_map,
+                     slack, overhead,
+                     [&keys, &overhead](const std::pair<const std::string, int32_t>& item) {
+                         keys += string_heap(item.first, overhead);
+                     });
+        usage.string_cache_map += slack + keys;
+    }
+
+    void filter(const LocusFilter& filter) {
+        usage.filter += filter.bytes();
+    }
+};
+
+
+inline MemoryUsage memory_usage(const LocusTable& table, const FrozenTable& frozen,
+                                const RecordArena& arena, const StringCache& cache,
+                                const LocusFilter& filter, size_t nfeatures) {
+    MemoryUsage usage;
+    usage.features.resize(nfeatures);
+    MemoryAccounting accounting(usage);
+    accounting.table(table);
+    accounting.frozen(frozen);
+    accounting.arena(arena);
+    accounting.cache(cache);
+    accounting.filter(filter);
+    return usage;
+}
+
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef merge_h
+#define merge_h
+
+#include <cinttypes>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "mapping.hpp"
+#include "records.hpp"
+#include "filter.hpp"
+#include "frozen.hpp"
+
+
+enum MergePolicy {
+    KEEP = 0,           // existing values of a feature win
+    OVERWRITE = 1,      // incoming values of a feature win
+    CONCATENATE = 2,    // incoming values are appended to existing ones
+    REPLACE = 3         // incoming records replace existing ones entirely
+};
+
+
+class RecordsMerge {
+    // Merges records of a source mapping into records of a target mapping
+    // feature by feature: features present on one side only are taken as is,
+    // features present on both sides are resolved by the policy. Source
+    // feature codes are remapped by name and cached strings are translated
+    // between the two string caches.
+
+private:
+
+    const std::vector<FeatureSpec>& target_features;
+    const std::vector<FeatureSpec>& source_features;
+    StringCache& target_cache;
+    const StringCache& source_cache;
+    RecordArena& arena;
+    MergePolicy policy;
+    std::vector<int> codes;     // target code of each source code
+    RecordsBuilder builder;
+    std::vector<RecordsReader> incoming;    // by target code
+    std::vector<bool> present;
+
+    void append(const RecordsReader& source, const std::vector<FeatureSpec>& features,
+                const StringCache& cache, uint8_t target_code) {
+        // Append the values of the reader's current feature to the builder's
+        // current feature, which is `target_code`
+        if (&features == &target_features && &cache == &target_cache) {
+            // same mapping: no translation needed
+            builder.add_values(source);
+            return;
+        }
+        RecordsReader reader = source;
+        const FeatureKind from = features[reader.code].kind;
+        const FeatureKind to = target_features[target_code].kind;
+        for (uint32_t i = 0; i < reader.count; ++i) {
+            if (from == FLOAT_FEATURE) {
+                builder.add_float(reader.number(i));
+            } else if (from == INT_FEATURE) {
+                builder.add_integer(reader.integer(i));
+            } else if (from == CACHED_FEATURE) {
+                const std::string value = cache.cache(reader.integer(i));
+                if (to == CACHED_FEATURE) {
+                    builder.add_integer(&cache == &target_cache ? reader.integer(i)
+                                                                : target_cache.cache(value));
+                } else {
+                    builder.add_string(value);
+                }
+            } else {
+                reader.read_string();
+                if (to == CACHED_FEATURE) {
+                    builder.add_integer(target_cache.cache(
+                        std::string(reader.string_data, reader.string_size)));
+                } else {
+                    builder.add_string(reader.string_data, reader.string_size);
+                }
+            }
+        }
+    }
+
+public:
+
+    RecordsMerge(const std::vector<FeatureSpec>& target_features,
+                 StringCache& target_cache, RecordArena& arena,
+                 const std::vector<FeatureSpec>& source_features,
+                 const StringCache& source_cache, MergePolicy policy):
+        target_features(target_features), source_features(source_features),
+        target_cache(target_cache), source_cache(source_cache), arena(arena),
+        policy(policy), incoming(256), present(256) {
+        for (size_t i = 0; i < source_features.size(); ++i) {
+            int code = -1;
+            for (size_t j = 0; j < target_features.size(); ++j) {
+                if (target_features[j].name == source_features[i].name) {
+                    code = (int)j;
+                }
+            }
+            if (code < 0) {
+                throw std::invalid_argument("feature '" + source_features[i].name +
+                                            "' is absent in the target mapping");
+            }
+            const FeatureKind from = source_features[i].kind;
+            const FeatureKind to = target_features[code].kind;
+            const bool strings = (from == STRING_FEATURE || from == CACHED_FEATURE) &&
+                                 (to == STRING_FEATURE || to == CACHED_FEATURE);
+            if (from != to && !strings) {
+                throw std::invalid_argument("feature '" + source_features[i].name +
+                                            "' has different types in the mappings");
+            }
+            codes.push_back(code);
+        }
+    }
+
+    Records merge(const Records* target, const Records& source) {
+        // Return the merged records; `target` is null for new loci
+        RecordsReader reader(source);
+        while (reader.next()) {
+            const int code = codes[reader.code];
+            incoming[code] = reader;
+            present[code] = true;
+        }
+        if (target && policy != REPLACE) {
+            RecordsReader existing(*target);
+            while (existing.next()) {
+                const uint8_t code = existing.code;
+                if (present[code] && policy == OVERWRITE) {
+                    continue;
+                }
+                builder.begin(code, target_features[code].kind == STRING_FEATURE);
+                append(existing, target_features, target_cache, code);
+                if (present[code]) {
+                    if (policy == CONCATENATE) {
+                        append(incoming[code], source_features, source_cache, code);
+                    }
+                    present[code] = false;
+                }
+            }
+        }
+        for (size_t code = 0; code < target_features.size(); ++code) {
+            if (present[code]) {
+                builder.begin((uint8_t)code, target_features[code].kind == STRING_FEATURE);
+                append(incoming[code], source_features, source_cache, (uint8_t)code);
+                present[code] = false;
+            }
+        }
+        return builder.finish(arena);
+    }
+};
+
+
+inline void merge_tables(LocusTable& target, LocusFilter& filter,
+                         const int16_t* contigs, const int16_t* bases,
+                         const LocusTable* table, const FrozenTable* frozen,
+                         RecordsMerge& merge) {
+    // Merge all loci of either `table` or `frozen` into `target`; `contigs`
+    // and `bases` translate source contig and base codes into target codes
+    // (-1 for codes absent in the target)
+    const size_t size = table ? table->size() : frozen->size();
+    target.reserve(target.size() + size);
+    LocusTable::const_iterator it;
+    if (table) {
+        it = table->begin();
+    }
+    for (size_t i = 0; i < size; ++i) {
+        const Locus source = Locus::unpack(table ? it->first.pack() : frozen->key(i));
+        const Records& records = table ? it->second : frozen->record(i);
+        if (table) {
+            ++it;
+        }
+        const int16_t chrom = contigs[source.chrom];
+        const int16_t ref = bases[(uint8_t)source.ref];
+        const int16_t alt = bases[(uint8_t)source.alt];
+        if (chrom < 0 || ref < 0 || alt < 0) {
+            throw std::invalid_argument("a contig or base of the source mapping "
+                                        "is absent in the target mapping");
+        }
+        const Locus locus((uint8_t)chrom, source.pos, (char)ref, (char)alt);
+        const size_t before = target.size();
+        Records& slot = target[locus];
+        slot = merge.merge(target.size() == before ? &slot : nullptr, records);
+        filter.insert(locus.pack());
+    }
+}
+
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef mphf_h
+#define mphf_h
+
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+#include "multiply.hpp"
+#include "sparsepp/spp.h"
+
+
+class MPHF {
+    // A BBHash-style minimal perfect hash function over a static set of
+    // 64-bit keys. Keys are hashed into a cascade of bit arrays: a key that
+    // lands alone in a bit of level `l` is placed there, colliding keys move
+    // on to level `l + 1`. A key's index is the rank of its bit among all set
+    // bits. The index takes ~3.5 bits per key at gamma = 2 (plus a 12.5%
+    // rank directory); the few keys left after MAXLEVELS levels go to a
+    // fallback map. Querying a key outside the set returns an arbitrary
+    // index, so callers must verify the key stored at that index.
+
+private:
+
+    static const size_t MAXLEVELS = 32;
+    static const size_t BLOCKWORDS = 8;  // 512-bit rank blocks
+
+    std::vector<uint64_t> bits;     // concatenated level bit arrays
+    std::vector<uint64_t> offsets;  // offsets[l]: the first bit of level l
+    std::vector<uint64_t> ranks;    // set bits preceding each rank block
+    spp::sparse_hash_map<uint64_t, uint64_t> fallback;
+    uint64_t nkeys;
+
+    static uint64_t hash(uint64_t key, size_t level) {
+        // splitmix64 finaliser over a per-level seed
+        uint64_t z = key ^ ((level + 1) * 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    static uint64_t reduce(uint64_t hash, uint64_t range) {
+        // map a hash onto [0, range) without a division
+        return mulhi64(hash, range);
+    }
+
+    uint64_t rank(uint64_t position) const {
+        const size_t word = position >> 6;
+        const size_t block = word / BLOCKWORDS;
+        uint64_t r = ranks[block];
+        for (size_t w = block * BLOCKWORDS; w < word; ++w) {
+            r += __builtin_popcountll(bits[w]);
+        }
+        return r + __builtin_popcountll(bits[word] & ((1ULL << (position & 63)) - 1));
+    }
+
+public:
+
+    MPHF(): offsets(1, 0), nkeys(0) {}
+
+    void build(std::vector<uint64_t> keys, double gamma) {
+        // `keys` must not contain duplicates
+        if (gamma < 1) {
+            throw std::invalid_argument("gamma must be at least 1");
+        }
+        bits.clear();
+        offsets.assign(1, 0);
+        fallback.clear();
+        nkeys = keys.size();
+        std::vector<uint64_t> collisions, next;
+        for (size_t level = 0; level < MAXLEVELS && !keys.empty(); ++level) {
+            const uint64_t nbits = std::max<uint64_t>(
+                64, ((uint64_t)std::ceil(gamma * keys.size()) + 63) & ~63ULL);
+            const size_t first = bits.size();
+            bits.resize(first + nbits / 64, 0);
+            collisions.assign(nbits / 64, 0);
+            uint64_t* level_bits = bits.data() + first;
+            for (size_t i = 0; i < keys.size(); ++i) {
+                const uint64_t h = reduce(hash(keys[i], level), nbits);
+                const uint64_t bit = 1ULL << (h & 63);
+                if (level_bits[h >> 6] & bit) {
+                    collisions[h >> 6] |= bit;
+                } else {
+                    level_bits[h >> 6] |= bit;
+                }
+            }
+            for (size_t w = 0; w < collisions.size(); ++w) {
+                level_bits[w] &= ~collisions[w];
+            }
+            next.clear();
+            for (size_t i = 0; i < keys.size(); ++i) {
+                const uint64_t h = reduce(hash(keys[i], level), nbits);
+                if (collisions[h >> 6] & (1ULL << (h & 63))) {
+                    next.push_back(keys[i]);
+                }
+            }
+            offsets.push_back(offsets.back() + nbits);
+            keys.swap(next);
+        }
+        ranks.assign(bits.size() / BLOCKWORDS + 1, 0);
+        uint64_t placed = 0;
+        for (size_t w = 0; w < bits.size(); ++w) {
+            if (w % BLOCKWORDS == 0) {
+                ranks[w / BLOCKWORDS] = placed;
+            }
+            placed += __builtin_popcountll(bits[w]);
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            fallback[keys[i]] = placed++;
+        }
+    }
+
+    uint64_t size() const {
+        return nkeys;
+    }
+
+    uint64_t operator()(uint64_t key) const {
+        // Return the index of `key`: a unique value in [0, size()) for keys
+        // in the set, an arbitrary value in [0, size()] otherwise
+        for (size_t level = 0; level + 1 < offsets.size(); ++level) {
+            const uint64_t position = offsets[level] + reduce(
+                hash(key, level), offsets[level + 1] - offsets[level]);
+            if (bits[position >> 6] & (1ULL << (position & 63))) {
+                return rank(position);
+            }
+        }
+        spp::sparse_hash_map<uint64_t, uint64_t>::const_iterator it =
+            fallback.find(key);
+        return it == fallback.end() ? nkeys : it->second;
+    }
+
+    void prefetch(uint64_t key) const {
+        // Prefetch the first-level bit (and its rank block) probed for `key`;
+        // most keys are placed at the first level
+        if (offsets.size() > 1) {
+            const uint64_t position = reduce(hash(key, 0), offsets[1]);
+            __builtin_prefetch(&bits[position >> 6]);
+            __builtin_prefetch(&ranks[(position >> 6) / BLOCKWORDS]);
+        }
+    }
+
+    size_t bytes() const {
+        // Approximate memory footprint of the index
+        return (bits.size() + offsets.size() + ranks.size()) * sizeof(uint64_t) +
+               fallback.size() * 2 * sizeof(uint64_t);
+    }
+};
+
+
+#endif
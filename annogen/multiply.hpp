@@ -0,0 +1,39 @@
+#ifndef multiply_h
+#define multiply_h
+
+#include <cinttypes>
+
+
+// 64x64-bit multiplication with a 128-bit result, for hash mixing and for
+// mapping hashes onto ranges without a division. GCC and Clang provide
+// unsigned __int128 on 64-bit targets; elsewhere the product is put
+// together from 32-bit halves.
+
+inline uint64_t mul128(uint64_t a, uint64_t b, uint64_t& high) {
+    // Return the low half of a * b and store the high half in `high`
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = (unsigned __int128)a * b;
+    high = (uint64_t)(product >> 64);
+    return (uint64_t)product;
+#else
+    const uint64_t a_low = (uint32_t)a, a_high = a >> 32;
+    const uint64_t b_low = (uint32_t)b, b_high = b >> 32;
+    const uint64_t low_low = a_low * b_low;
+    const uint64_t high_low = a_high * b_low;
+    const uint64_t low_high = a_low * b_high;
+    const uint64_t cross = (low_low >> 32) + (uint32_t)high_low + low_high;
+    high = a_high * b_high + (high_low >> 32) + (cross >> 32);
+    return (cross << 32) | (uint32_t)low_low;
+#endif
+}
+
+
+inline uint64_t mulhi64(uint64_t a, uint64_t b) {
+    // The high half of a * b, i.e. floor(a * b / 2^64): maps a uniform `a`
+    // onto [0, b)
+    uint64_t high;
+    mul128(a, b, high);
+    return high;
+}
+
+#endif
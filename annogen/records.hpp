@@ -0,0 +1,508 @@
+#ifndef records_h
+#define records_h
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+// All records of a locus are serialised into one contiguous blob:
+//
+//   varint    size of the rest of the blob
+//   uint8     number of bitmap bytes B
+//   B bytes   feature bitmap: bit c is set if feature c is present
+//   varints   a header per present feature in code order: the number of
+//             values << 1, | 1 for string features
+//   numeric   4-byte values (float or int32) of numeric features in code order
+//   strings   varint length and bytes of each string value in code order
+//
+// so decoding a locus touches one or two cache lines instead of a separate
+// heap block per feature; small blobs need no memory beyond the table slot.
+// Whether numeric values are floats or integers (including cached string
+// codes) is up to the feature's declared kind.
+
+
+enum FeatureKind {
+    STRING_FEATURE = 0,
+    FLOAT_FEATURE = 1,
+    INT_FEATURE = 2,
+    CACHED_FEATURE = 3      // strings stored as StringCache codes
+};
+
+
+struct FeatureSpec {
+    // Feature codes are positions in a vector of FeatureSpecs
+    std::string name;
+    FeatureKind kind;
+
+    FeatureSpec(): kind(STRING_FEATURE) {}
+    FeatureSpec(const std::string& name, FeatureKind kind):
+        name(name), kind(kind) {}
+};
+
+
+inline size_t varint_size(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+
+inline uint8_t* write_varint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+
+inline uint64_t read_varint(const uint8_t*& in) {
+    uint64_t value = 0;
+    for (int shift = 0; ; shift += 7) {
+        const uint8_t byte = *in++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+}
+
+
+class RecordArena {
+    // A bump allocator for record blobs: blobs are packed back to back into
+    // large chunks and are only released all at once
+
+private:
+
+    static const size_t CHUNK = 1 << 20;
+
+    std::vector<std::unique_ptr<uint8_t[]>> chunks;
+    uint8_t* cursor;
+    size_t left;        // bytes left in the current chunk
+    size_t reserved;    // bytes held in all chunks
+    size_t allocated;   // bytes handed out
+
+public:
+
+    RecordArena(): cursor(nullptr), left(0), reserved(0), allocated(0) {}
+    RecordArena(const RecordArena&) = delete;
+    RecordArena& operator=(const RecordArena&) = delete;
+
+    uint8_t* allocate(size_t size) {
+        allocated += size;
+        if (size > CHUNK / 8) {
+            // large blobs get a chunk of their own
+            chunks.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[size]));
+            reserved += size;
+            return chunks.back().get();
+        }
+        if (size > left) {
+            chunks.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[CHUNK]));
+            cursor = chunks.back().get();
+            left = CHUNK;
+            reserved += CHUNK;
+        }
+        uint8_t* blob = cursor;
+        cursor += size;
+        left -= size;
+        return blob;
+    }
+
+    size_t bytes() const {
+        return reserved;
+    }
+
+    size_t used() const {
+        return allocated;
+    }
+
+    void clear() {
+        chunks.clear();
+        cursor = nullptr;
+        left = reserved = allocated = 0;
+    }
+
+    void swap(RecordArena& other) {
+        chunks.swap(other.chunks);
+        std::swap(cursor, other.cursor);
+        std::swap(left, other.left);
+        std::swap(reserved, other.reserved);
+        std::swap(allocated, other.allocated);
+    }
+};
+
+
+class Records {
+    // The records of a Locus: a blob of at most INLINE bytes is stored inline
+    // in the handle itself (and thus in the table slot), larger blobs spill
+    // to a RecordArena and the handle holds a pointer to them. Loci without
+    // features have no blob. Handles never own arena blobs.
+
+public:
+
+    static const size_t INLINE = 15;
+
+private:
+
+    // an inline blob, or a pointer to an arena blob in the first 8 bytes;
+    // the last byte tags inline blobs
+    alignas(8) uint8_t storage[INLINE + 1];
+
+    const uint8_t* pointer() const {
+        const uint8_t* blob;
+        std::memcpy(&blob, storage, sizeof(blob));
+        return blob;
+    }
+
+public:
+
+    Records() {
+        std::memset(storage, 0, sizeof(storage));
+    }
+
+    explicit Records(const uint8_t* blob) {
+        std::memset(storage, 0, sizeof(storage));
+        std::memcpy(storage, &blob, sizeof(blob));
+    }
+
+    uint8_t* allocate(size_t size, RecordArena& arena) {
+        // Make room for a blob of `size` bytes, inline if it fits
+        std::memset(storage, 0, sizeof(storage));
+        if (size <= INLINE) {
+            storage[INLINE] = 1;
+            return storage;
+        }
+        uint8_t* blob = arena.allocate(size);
+        std::memcpy(storage, &blob, sizeof(blob));
+        return blob;
+    }
+
+    bool is_inline() const {
+        return storage[INLINE];
+    }
+
+    const uint8_t* data() const {
+        return is_inline() ? storage : pointer();
+    }
+
+    size_t size() const {
+        // The size of the blob, including the size prefix
+        const uint8_t* blob = data();
+        if (!blob) {
+            return 0;
+        }
+        const uint8_t* in = blob;
+        const uint64_t rest = read_varint(in);
+        return (in - blob) + rest;
+    }
+
+    size_t nfeatures() const {
+        const uint8_t* in = data();
+        if (!in) {
+            return 0;
+        }
+        read_varint(in);
+        const uint8_t nbitmap = *in++;
+        size_t n = 0;
+        for (uint8_t i = 0; i < nbitmap; ++i) {
+            n += __builtin_popcount(in[i]);
+        }
+        return n;
+    }
+
+    bool contains(uint8_t code) const {
+        const uint8_t* in = data();
+        if (!in) {
+            return false;
+        }
+        read_varint(in);
+        const uint8_t nbitmap = *in++;
+        return code / 8 < nbitmap && (in[code / 8] >> (code % 8) & 1);
+    }
+
+    explicit operator bool() const {
+        return data() != nullptr;
+    }
+};
+
+
+class RecordsReader {
+    // Iterates over the features of a record blob in code order:
+    //
+    //     RecordsReader reader(records);
+    //     while (reader.next()) {
+    //         ... reader.code, reader.is_string, reader.count ...
+    //     }
+    //
+    // Numeric values are read with number(i) or integer(i); the string values
+    // of a feature are read in order by calling read_string() `count` times.
+
+private:
+
+    const uint8_t* bitmap;
+    size_t nbitmap;
+    size_t bit;                 // the next code to test
+    const uint8_t* header;      // the next feature header
+    const uint8_t* numbers;     // values of the current numeric feature
+    const uint8_t* strings;     // strings of the current string feature
+    const uint8_t* string;      // the next string to read
+
+public:
+
+    uint8_t code;
+    bool is_string;
+    uint32_t count;
+    const char* string_data;    // set by read_string
+    size_t string_size;
+
+    RecordsReader():
+        bitmap(nullptr), nbitmap(0), bit(0), header(nullptr), numbers(nullptr),
+        strings(nullptr), string(nullptr), code(0), is_string(false), count(0),
+        string_data(nullptr), string_size(0) {}
+
+    explicit RecordsReader(const Records& records): RecordsReader() {
+        const uint8_t* in = records.data();
+        if (!in) {
+            return;
+        }
+        read_varint(in);
+        nbitmap = *in++;
+        bitmap = in;
+        header = in + nbitmap;
+        // skip the headers to find the numeric and string blocks
+        const uint8_t* end = header;
+        size_t nfeatures = records.nfeatures();
+        size_t nnumbers = 0;
+        for (size_t i = 0; i < nfeatures; ++i) {
+            const uint64_t value = read_varint(end);
+            if (!(value & 1)) {
+                nnumbers += value >> 1;
+            }
+        }
+        numbers = end;
+        strings = end + 4 * nnumbers;
+        string = strings;
+    }
+
+    bool next() {
+        // Advance to the next feature; return false after the last one
+        if (count) {
+            if (is_string) {
+                // skip strings of the current feature that were not read
+                string = strings;
+                for (uint32_t i = 0; i < count; ++i) {
+                    const uint64_t size = read_varint(string);
+                    string += size;
+                }
+                strings = string;
+            } else {
+                numbers += 4 * count;
+            }
+        }
+        while (bit < 8 * nbitmap && !(bitmap[bit / 8] >> (bit % 8) & 1)) {
+            ++bit;
+        }
+        if (bit == 8 * nbitmap) {
+            count = 0;
+            return false;
+        }
+        code = (uint8_t)bit++;
+        const uint64_t value = read_varint(header);
+        is_string = value & 1;
+        count = (uint32_t)(value >> 1);
+        string = strings;
+        return true;
+    }
+
+    bool find(uint8_t target) {
+        // Advance to feature `target`; return false if it is absent
+        while (next()) {
+            if (code == target) {
+                return true;
+            }
+            if (code > target) {
+                return false;
+            }
+        }
+        return false;
+    }
+
+    const uint8_t* values() const {
+        // Raw 4-byte values of the current numeric feature
+        return numbers;
+    }
+
+    float number(size_t i) const {
+        float value;
+        std::memcpy(&value, numbers + 4 * i, 4);
+        return value;
+    }
+
+    int32_t integer(size_t i) const {
+        int32_t value;
+        std::memcpy(&value, numbers + 4 * i, 4);
+        return value;
+    }
+
+    void read_string() {
+        string_size = read_varint(string);
+        string_data = (const char*)string;
+        string += string_size;
+    }
+
+    const uint8_t* string_values() const {
+        // Raw varint-prefixed strings of the current string feature
+        return strings;
+    }
+
+    size_t string_bytes() const {
+        // The size of string_values()
+        const uint8_t* end = strings;
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint64_t size = read_varint(end);
+            end += size;
+        }
+        return end - strings;
+    }
+};
+
+
+class RecordsBuilder {
+    // Collects feature values (features in any order, the values of each
+    // feature in order) and serialises them into a record blob
+
+private:
+
+    struct Entry {
+        uint8_t code;
+        bool is_string;
+        uint32_t count;
+        size_t start;   // offset into `numbers` or `strings`
+        size_t size;    // bytes
+    };
+
+    std::vector<Entry> entries;
+    std::vector<uint8_t> numbers;
+    std::vector<uint8_t> strings;
+
+    static bool by_code(const Entry& a, const Entry& b) {
+        return a.code < b.code;
+    }
+
+    template <class T>
+    void add_number(T value) {
+        const size_t size = numbers.size();
+        numbers.resize(size + 4);
+        std::memcpy(numbers.data() + size, &value, 4);
+        ++entries.back().count;
+        entries.back().size += 4;
+    }
+
+public:
+
+    void begin(uint8_t code, bool is_string) {
+        // Start a feature; values added next belong to it
+        Entry entry = {code, is_string, 0, is_string ? strings.size() : numbers.size(), 0};
+        entries.push_back(entry);
+    }
+
+    void add_float(float value) {
+        add_number(value);
+    }
+
+    void add_integer(int32_t value) {
+        add_number(value);
+    }
+
+    void add_string(const char* data, size_t size) {
+        const size_t start = strings.size();
+        strings.resize(start + varint_size(size) + size);
+        uint8_t* out = write_varint(strings.data() + start, size);
+        std::memcpy(out, data, size);
+        ++entries.back().count;
+        entries.back().size += strings.size() - start;
+    }
+
+    void add_string(const std::string& value) {
+        add_string(value.data(), value.size());
+    }
+
+    void add_values(const RecordsReader& reader) {
+        // Copy all values of the reader's current feature as they are
+        const uint8_t* begin = reader.is_string ? reader.string_values() : reader.values();
+        const size_t size = reader.is_string ? reader.string_bytes() : 4 * reader.count;
+        std::vector<uint8_t>& block = reader.is_string ? strings : numbers;
+        block.insert(block.end(), begin, begin + size);
+        entries.back().count += reader.count;
+        entries.back().size += size;
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    void clear() {
+        entries.clear();
+        numbers.clear();
+        strings.clear();
+    }
+
+    Records finish(RecordArena& arena) {
+        // Serialise the collected features into a blob, inline or allocated
+        // from `arena`, and start over; duplicate features are an error
+        if (entries.empty()) {
+            return Records();
+        }
+        std::stable_sort(entries.begin(), entries.end(), by_code);
+        size_t payload = 1 + entries.back().code / 8 + 1;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (i && entries[i].code == entries[i - 1].code) {
+                clear();
+                throw std::invalid_argument("duplicate feature in a record");
+            }
+            payload += varint_size((uint64_t)entries[i].count << 1 | entries[i].is_string);
+            payload += entries[i].size;
+        }
+        Records records;
+        uint8_t* out = write_varint(
+            records.allocate(varint_size(payload) + payload, arena), payload);
+        const uint8_t nbitmap = (uint8_t)(entries.back().code / 8 + 1);
+        *out++ = nbitmap;
+        std::memset(out, 0, nbitmap);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            out[entries[i].code / 8] |= (uint8_t)(1 << (entries[i].code % 8));
+        }
+        out += nbitmap;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            out = write_varint(out, (uint64_t)entries[i].count << 1 | entries[i].is_string);
+        }
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (!entries[i].is_string) {
+                std::memcpy(out, numbers.data() + entries[i].start, entries[i].size);
+                out += entries[i].size;
+            }
+        }
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i].is_string) {
+                std::memcpy(out, strings.data() + entries[i].start, entries[i].size);
+                out += entries[i].size;
+            }
+        }
+        clear();
+        return records;
+    }
+};
+
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef simd_h
+#define simd_h
+
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include "mapping.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ANNOGEN_X86 1
+#include <immintrin.h>
+#endif
+
+#ifdef SPP_MIX_HASH
+// the kernels reproduce std::hash<Locus>, which is only the table's bucket
+// hash as long as sparsepp does not remix it
+#error "annogen's batch kernels require sparsepp's SPP_MIX_HASH to be off"
+#endif
+
+
+// Batch key construction. The kernels take a batch of loci as separate
+// contig/pos/ref/alt arrays and write packed keys (see Locus::pack) and,
+// optionally, their hashes under the default policy (SPP_HASH). The hashes
+// are bit-identical to std::hash<Locus>: four spp::hash_combine rounds with
+// spp's 32-bit mixer applied to the position. Other policies hash the packed
+// keys afterwards (see hash_keys). AVX2 handles 8 loci per iteration (two 4-lane
+// halves of 64-bit arithmetic), SSE4.2 handles 4; the scalar kernel is the
+// reference and the fallback on other CPUs.
+
+typedef void (*PackKernel)(const uint8_t* contigs, const uint32_t* positions,
+                           const char* refs, const char* alts, size_t n,
+                           uint64_t* keys, size_t* hashes);
+
+
+inline void pack_loci_scalar(const uint8_t* contigs, const uint32_t* positions,
+                             const char* refs, const char* alts, size_t n,
+                             uint64_t* keys, size_t* hashes) {
+    const std::hash<Locus> hasher;
+    for (size_t i = 0; i < n; ++i) {
+        const Locus locus(contigs[i], positions[i], refs[i], alts[i]);
+        keys[i] = locus.pack();
+        if (hashes) {
+            hashes[i] = hasher(locus);
+        }
+    }
+}
+
+
+#ifdef ANNOGEN_X86
+
+__attribute__((target("avx2")))
+inline __m256i combine_avx2(__m256i seed, __m256i value) {
+    // spp::Combiner<size_t, 8>
+    const __m256i golden = _mm256_set1_epi64x((long long)0xc6a4a7935bd1e995ULL);
+    __m256i rhs = _mm256_add_epi64(value, golden);
+    rhs = _mm256_add_epi64(rhs, _mm256_slli_epi64(seed, 6));
+    rhs = _mm256_add_epi64(rhs, _mm256_srli_epi64(seed, 2));
+    return _mm256_xor_si256(seed, rhs);
+}
+
+
+__attribute__((target("avx2")))
+inline void pack_loci_avx2(const uint8_t* contigs, const uint32_t* positions,
+                           const char* refs, const char* alts, size_t n,
+                           uint64_t* keys, size_t* hashes) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i pos = _mm256_loadu_si256((const __m256i*)(positions + i));
+        // spp::spp_mix_32 in 32-bit lanes
+        __m256i mixed = _mm256_xor_si256(pos, _mm256_srli_epi32(pos, 4));
+        mixed = _mm256_add_epi32(
+            _mm256_xor_si256(mixed, _mm256_set1_epi32((int)0xdeadbeef)),
+            _mm256_slli_epi32(mixed, 5));
+        mixed = _mm256_xor_si256(mixed, _mm256_srli_epi32(mixed, 11));
+        for (size_t half = 0; half < 2; ++half) {
+            const size_t j = i + 4 * half;
+            int32_t c4, r4, a4;
+            std::memcpy(&c4, contigs + j, 4);
+            std::memcpy(&r4, refs + j, 4);
+            std::memcpy(&a4, alts + j, 4);
+            const __m256i chrom = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(c4));
+            const __m256i pos64 = _mm256_cvtepu32_epi64(
+                half ? _mm256_extracti128_si256(pos, 1) : _mm256_castsi256_si128(pos));
+            const __m256i ref = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(r4));
+            const __m256i alt = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(a4));
+            const __m256i key = _mm256_or_si256(
+                _mm256_or_si256(_mm256_slli_epi64(chrom, 48), _mm256_slli_epi64(pos64, 16)),
+                _mm256_or_si256(_mm256_slli_epi64(ref, 8), alt));
+            _mm256_storeu_si256((__m256i*)(keys + j), key);
+            if (hashes) {
+                // std::hash<char> sign-extends
+                const __m256i sref = _mm256_cvtepi8_epi64(_mm_cvtsi32_si128(r4));
+                const __m256i salt = _mm256_cvtepi8_epi64(_mm_cvtsi32_si128(a4));
+                const __m256i mix64 = _mm256_cvtepu32_epi64(
+                    half ? _mm256_extracti128_si256(mixed, 1) : _mm256_castsi256_si128(mixed));
+                __m256i seed = combine_avx2(_mm256_setzero_si256(), chrom);
+                seed = combine_avx2(seed, mix64);
+                seed = combine_avx2(seed, sref);
+                seed = combine_avx2(seed, salt);
+                _mm256_storeu_si256((__m256i*)(hashes + j), seed);
+            }
+        }
+    }
+    pack_loci_scalar(contigs + i, positions + i, refs + i, alts + i, n - i,
+                     keys + i, hashes ? hashes + i : nullptr);
+}
+
+
+__attribute__((target("sse4.2")))
+inline __m128i combine_sse42(__m128i seed, __m128i value) {
+    const __m128i golden = _mm_set1_epi64x((long long)0xc6a4a7935bd1e995ULL);
+    __m128i rhs = _mm_add_epi64(value, golden);
+    rhs = _mm_add_epi64(rhs, _mm_slli_epi64(seed, 6));
+    rhs = _mm_add_epi64(rhs, _mm_srli_epi64(seed, 2));
+    return _mm_xor_si128(seed, rhs);
+}
+
+
+__attribute__((target("sse4.2")))
+inline void pack_loci_sse42(const uint8_t* contigs, const uint32_t* positions,
+                            const char* refs, const char* alts, size_t n,
+                            uint64_t* keys, size_t* hashes) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i pos = _mm_loadu_si128((const __m128i*)(positions + i));
+        __m128i mixed = _mm_xor_si128(pos, _mm_srli_epi32(pos, 4));
+        mixed = _mm_add_epi32(_mm_xor_si128(mixed, _mm_set1_epi32((int)0xdeadbeef)),
+                              _mm_slli_epi32(mixed, 5));
+        mixed = _mm_xor_si128(mixed, _mm_srli_epi32(mixed, 11));
+        for (size_t half = 0; half < 2; ++half) {
+            const size_t j = i + 2 * half;
+            int16_t c2, r2, a2;
+            std::memcpy(&c2, contigs + j, 2);
+            std::memcpy(&r2, refs + j, 2);
+            std::memcpy(&a2, alts + j, 2);
+            const __m128i chrom = _mm_cvtepu8_epi64(_mm_cvtsi32_si128((uint16_t)c2));
+            const __m128i pos64 = _mm_cvtepu32_epi64(half ? _mm_srli_si128(pos, 8) : pos);
+            const __m128i ref = _mm_cvtepu8_epi64(_mm_cvtsi32_si128((uint16_t)r2));
+            const __m128i alt = _mm_cvtepu8_epi64(_mm_cvtsi32_si128((uint16_t)a2));
+            const __m128i key = _mm_or_si128(
+                _mm_or_si128(_mm_slli_epi64(chrom, 48), _mm_slli_epi64(pos64, 16)),
+                _mm_or_si128(_mm_slli_epi64(ref, 8), alt));
+            _mm_storeu_si128((__m128i*)(keys + j), key);
+            if (hashes) {
+                const __m128i sref = _mm_cvtepi8_epi64(_mm_cvtsi32_si128((uint16_t)r2));
+                const __m128i salt = _mm_cvtepi8_epi64(_mm_cvtsi32_si128((uint16_t)a2));
+                const __m128i mix64 = _mm_cvtepu32_epi64(half ? _mm_srli_si128(mixed, 8) : mixed);
+                __m128i seed = combine_sse42(_mm_setzero_si128(), chrom);
+                seed = combine_sse42(seed, mix64);
+                seed = combine_sse42(seed, sref);
+                seed = combine_sse42(seed, salt);
+                _mm_storeu_si128((__m128i*)(hashes + j), seed);
+            }
+        }
+    }
+    pack_loci_scalar(contigs + i, positions + i, refs + i, alts + i, n - i,
+                     keys + i, hashes ? hashes + i : nullptr);
+}
+
+#endif
+
+
+inline PackKernel select_pack_kernel() {
+#ifdef ANNOGEN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return pack_loci_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return pack_loci_sse42;
+    }
+#endif
+    return pack_loci_scalar;
+}
+
+
+inline void pack_loci(const uint8_t* contigs, const uint32_t* positions,
+                      const char* refs, const char* alts, size_t n,
+                      uint64_t* keys, size_t* hashes) {
+    // Pack `n` loci into `keys` and, unless `hashes` is null, write their
+    // std::hash<Locus> values into `hashes`; the kernel is picked once for
+    // the running CPU
+    static const PackKernel kernel = select_pack_kernel();
+    kernel(contigs, positions, refs, alts, n, keys, hashes);
+}
+
+
+#endif
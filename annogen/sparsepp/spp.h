@@ -1178,6 +1178,12 @@ public:
         return _pos_to_offset(_bitmap, pos);
     }
 
+    // annogen: prefetch the slot item `pos` occupies (or would occupy)
+    void prefetch(size_type pos) const
+    {
+        __builtin_prefetch(_group + pos_to_offset(pos));
+    }
+
 #ifdef _MSC_VER
 #pragma warning(push)
 #pragma warning(disable : 4146)
@@ -2136,6 +2142,18 @@ public:
         return which_group(i).test_strict(pos_in_group(i));
     }
 
+    // annogen: prefetch the group header (bitmaps and item pointer) of
+    // bucket `i`, then, once it is cached, the item slot itself
+    void prefetch_group(size_type i) const
+    {
+        __builtin_prefetch(&which_group(i));
+    }
+
+    void prefetch_item(size_type i) const
+    {
+        which_group(i).prefetch(pos_in_group(i));
+    }
+
     friend struct GrpPos;
 
     struct GrpPos
@@ -3116,6 +3134,53 @@ public:
         }
     }
 
+    // annogen: split lookups for batched probing. `hash_key` computes the
+    // (mixed) hash once, `prefetch` pulls in the group header (items=false)
+    // or the first probed slot (items=true), `find_hashed` is find() const
+    // with a precomputed hash.
+    // ------------------------------------------------------------------
+    size_t hash_key(const key_type& key) const
+    {
+        return hash(key);
+    }
+
+    void prefetch(size_t hashed, bool items) const
+    {
+        if (!bucket_count())
+            return;
+        const size_type bucknum = hashed & (bucket_count() - 1);
+        if (items)
+            table.prefetch_item(bucknum);
+        else
+            table.prefetch_group(bucknum);
+    }
+
+    const_iterator find_hashed(const key_type& key, size_t hashed) const
+    {
+        size_type num_probes = 0;              // how many times we've probed
+        const size_type bucket_count_minus_one = bucket_count() - 1;
+        size_type bucknum = hashed & bucket_count_minus_one;
+
+        while (1)                        // probe until something happens
+        {
+            typename Table::GrpPos grp_pos(table, bucknum);
+
+            if (!grp_pos.test_strict())
+                return end();            // bucket is empty
+            else if (grp_pos.test())
+            {
+                reference ref(grp_pos.unsafe_get());
+
+                if (equals(key, get_key(ref)))
+                    return _mk_const_iterator(table.get_iter(bucknum, &ref));
+            }
+            ++num_probes;                        // we're doing another probe
+            bucknum = (bucknum + JUMP_(key, num_probes)) & bucket_count_minus_one;
+            assert(num_probes < bucket_count()
+                   && "Hashtable is full: an error in key_equal<> or hash<>");
+        }
+    }
+
     // This is a tr1 method: the bucket a given key is in, or what bucket
     // it would be put in, if it were to be inserted.  Shrug.
     // ------------------------------------------------------------------
@@ -3258,10 +3323,17 @@ public:
     // representing the default value to be inserted if none is found.
     template <class DefaultValue>
     value_type& find_or_insert(const key_type& key)
+    {
+        return find_or_insert_hashed<DefaultValue>(key, hash(key));
+    }
+
+    // annogen: find_or_insert with a precomputed hash (see find_hashed)
+    template <class DefaultValue>
+    value_type& find_or_insert_hashed(const key_type& key, size_t hashed)
     {
         size_type num_probes = 0;              // how many times we've probed
         const size_type bucket_count_minus_one = bucket_count() - 1;
-        size_type bucknum = hash(key) & bucket_count_minus_one;
+        size_type bucknum = hashed & bucket_count_minus_one;
         DefaultValue default_value;
         size_type erased_pos = 0;
         bool erased = false;
@@ -3792,6 +3864,16 @@ public:
     const_iterator find(const key_type& key) const     { return rep.find(key); }
     bool contains(const key_type& key) const           { return rep.find(key) != rep.end(); }
 
+    // annogen: batched lookups (see sparse_hashtable::find_hashed)
+    size_t hash_key(const key_type& key) const         { return rep.hash_key(key); }
+    void prefetch(size_t hashed, bool items) const     { rep.prefetch(hashed, items); }
+    const_iterator find_hashed(const key_type& key, size_t hashed) const
+                                                       { return rep.find_hashed(key, hashed); }
+    mapped_type& find_or_insert_hashed(const key_type& key, size_t hashed)
+    {
+        return rep.template find_or_insert_hashed<DefaultValue>(key, hashed).second;
+    }
+
     mapped_type& operator[](const key_type& key)
     {
         return rep.template find_or_insert<DefaultValue>(key).second;
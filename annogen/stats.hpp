@@ -0,0 +1,533 @@
+#ifndef stats_h
+#define stats_h
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "mapping.hpp"
+#include "records.hpp"
+#include "frozen.hpp"
+#include "hashing.hpp"
+
+
+// Hot-path instrumentation: counters and latency histograms of lookups,
+// inserts and decoding. Compiled in with -DANNOGEN_STATS=1; otherwise every
+// recording call is an empty inline function and no clock is read.
+
+#ifndef ANNOGEN_STATS
+#define ANNOGEN_STATS 0
+#endif
+
+
+inline uint64_t stats_clock() {
+    // Nanoseconds from a monotonic clock, or 0 with stats compiled out
+    if (!ANNOGEN_STATS) {
+        return 0;
+    }
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+class LatencyHistogram {
+    // An HDR-style log-linear histogram: values below SUB are counted
+    // exactly, larger ones in SUB buckets per power of two, so every bucket
+    // is at most 1/SUB (~6%) wide relative to its values
+
+private:
+
+    static const int SUBBITS = 4;
+    static const uint64_t SUB = 1 << SUBBITS;
+    static const size_t NBUCKETS = ANNOGEN_STATS ? (64 - SUBBITS + 1) * SUB : 1;
+
+    uint64_t buckets[NBUCKETS];
+    uint64_t total;
+    uint64_t sum;
+    uint64_t low;
+    uint64_t high;
+
+    static size_t bucket(uint64_t value) {
+        if (value < SUB) {
+            return value;
+        }
+        const int exponent = 63 - __builtin_clzll(value);
+        return (exponent - SUBBITS + 1) * SUB + ((value >> (exponent - SUBBITS)) & (SUB - 1));
+    }
+
+    static uint64_t upper(size_t index) {
+        // the largest value counted in bucket `index`
+        if (index < SUB) {
+            return index;
+        }
+        const int exponent = (int)(index / SUB) + SUBBITS - 1;
+        const uint64_t first = (SUB | (index % SUB)) << (exponent - SUBBITS);
+        return first + ((uint64_t)1 << (exponent - SUBBITS)) - 1;
+    }
+
+public:
+
+    LatencyHistogram() {
+        clear();
+    }
+
+    void clear() {
+        std::fill(buckets, buckets + NBUCKETS, 0);
+        total = sum = high = 0;
+        low = UINT64_MAX;
+    }
+
+    void record(uint64_t value) {
+        if (!ANNOGEN_STATS) {
+            return;
+        }
+        ++buckets[bucket(value)];
+        ++total;
+        sum += value;
+        low = std::min(low, value);
+        high = std::max(high, value);
+    }
+
+    uint64_t count() const {
+        return total;
+    }
+
+    double mean() const {
+        return total ? (double)sum / total : 0;
+    }
+
+    uint64_t min() const {
+        return total ? low : 0;
+    }
+
+    uint64_t max() const {
+        return high;
+    }
+
+    uint64_t percentile(double q) const {
+        // An upper bound of the q-th percentile (0 < q <= 100)
+        if (!total) {
+            return 0;
+        }
+        const uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q / 100 * total + 0.5));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < NBUCKETS; ++i) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                return std::min(upper(i), high);
+            }
+        }
+        return high;
+    }
+};
+
+
+struct MappingStats {
+    // Counters and latencies (in nanoseconds) of a mapping
+
+    uint64_t lookups;           // single lookups
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t filter_rejects;    // single lookups answered by the Bloom filter
+    uint64_t batches;           // batched lookups
+    uint64_t batch_loci;
+    uint64_t batch_hits;
+    uint64_t inserts;           // calls, single or bulk
+    uint64_t inserted;          // loci
+    uint64_t decodes;           // decoded records
+    uint64_t decoded_values;
+    uint64_t cache_hits;        // strings already in the string cache
+    uint64_t cache_misses;      // strings added to it
+    LatencyHistogram lookup_latency;
+    LatencyHistogram batch_latency;     // per batch
+    LatencyHistogram insert_latency;    // per call
+    LatencyHistogram decode_latency;    // per record
+
+    MappingStats() {
+        clear();
+    }
+
+    void clear() {
+        lookups = hits = misses = filter_rejects = batches = batch_loci =
+            batch_hits = inserts = inserted = decodes = decoded_values =
+            cache_hits = cache_misses = 0;
+        lookup_latency.clear();
+        batch_latency.clear();
+        insert_latency.clear();
+        decode_latency.clear();
+    }
+
+    void lookup(uint64_t start, const Records* found, bool filtered) {
+        if (!ANNOGEN_STATS) {
+            return;
+        }
+        lookup_latency.record(stats_clock() - start);
+        ++lookups;
+        ++(found ? hits : misses);
+        filter_rejects += filtered;
+    }
+
+    void batch(uint64_t start, const Records* const* found, size_t n) {
+        if (!ANNOGEN_STATS) {
+            return;
+        }
+        batch_latency.record(stats_clock() - start);
+        ++batches;
+        batch_loci += n;
+        for (size_t i = 0; i < n; ++i) {
+            batch_hits += found[i] != nullptr;
+        }
+    }
+
+    void insert(uint64_t start, size_t n) {
+        if (!ANNOGEN_STATS) {
+            return;
+        }
+        insert_latency.record(stats_clock() - start);
+        ++inserts;
+        inserted += n;
+    }
+
+    void decode(uint64_t start, size_t values) {
+        if (!ANNOGEN_STATS) {
+            return;
+        }
+        decode_latency.record(stats_clock() - start);
+        ++decodes;
+        decoded_values += values;
+    }
+
+    void cache(size_t n, size_t added) {
+        if (!ANNOGEN_STATS) {
+            return;
+        }
+        cache_hits += n - added;
+        cache_misses += added;
+    }
+};
+
+
+struct ProbeStats {
+    // Probe statistics of a LocusTable (recomputed on demand, so available
+    // with stats compiled out as well)
+    uint64_t size;
+    uint64_t buckets;
+    uint64_t displaced;         // keys not in their home bucket
+    uint64_t hash_collisions;   // keys sharing their full hash with another
+    uint64_t max_probes;        // of a successful lookup
+    double mean_probes;         // of a successful lookup
+    double mean_miss_probes;    // of an unsuccessful lookup, over home buckets
+    std::vector<uint64_t> probes;   // number of keys by probe count
+
+    ProbeStats(): size(0), buckets(0), displaced(0), hash_collisions(0),
+                  max_probes(0), mean_probes(0), mean_miss_probes(0) {}
+};
+
+
+inline uint64_t count_collisions(std::vector<size_t>& hashes) {
+    // The number of hashes equal to another one; sorts `hashes`
+    std::sort(hashes.begin(), hashes.end());
+    uint64_t collisions = 0;
+    for (size_t i = 0; i < hashes.size(); ) {
+        size_t j = i + 1;
+        while (j < hashes.size() && hashes[j] == hashes[i]) {
+            ++j;
+        }
+        collisions += j - i > 1 ? j - i : 0;
+        i = j;
+    }
+    return collisions;
+}
+
+
+template <class Occupied>
+double mean_miss_probes(size_t buckets, Occupied occupied) {
+    // A miss probes from its home bucket until an empty one; averaged over
+    // all home buckets. Triangular probing visits every bucket within
+    // `buckets` probes, so a miss in a full table counts as `buckets` probes
+    const size_t mask = buckets - 1;
+    uint64_t misses = 0;
+    for (size_t home = 0; home < buckets; ++home) {
+        size_t bucket = home;
+        uint64_t probes = 1;
+        while (probes < buckets && occupied(bucket)) {
+            bucket = (bucket + probes) & mask;
+            ++probes;
+        }
+        misses += probes;
+    }
+    return (double)misses / buckets;
+}
+
+
+template <class Hasher>
+ProbeStats probe_stats(const spp::sparse_hash_map<Locus, Records, Hasher>& table) {
+    // Replay sparsepp's quadratic (triangular) probing from the home bucket
+    // of every key to the bucket it occupies
+    typedef spp::sparse_hash_map<Locus, Records, Hasher> Table;
+    ProbeStats stats;
+    stats.size = table.size();
+    stats.buckets = table.bucket_count();
+    if (!stats.size) {
+        return stats;
+    }
+    const size_t mask = stats.buckets - 1;
+    const Hasher hasher = table.hash_function();
+    std::vector<size_t> hashes;
+    hashes.reserve(stats.size);
+    uint64_t total = 0;
+    for (typename Table::const_iterator it = table.begin(); it != table.end(); ++it) {
+        const size_t hash = hasher(it->first);
+        hashes.push_back(hash);
+        const size_t target = table.bucket(it->first);
+        size_t bucket = hash & mask;
+        uint64_t probes = 0;
+        while (bucket != target) {
+            ++probes;
+            bucket = (bucket + probes) & mask;
+        }
+        if (stats.probes.size() <= probes) {
+            stats.probes.resize(probes + 1);
+        }
+        ++stats.probes[probes];
+        stats.displaced += probes > 0;
+        stats.max_probes = std::max(stats.max_probes, probes);
+        total += probes + 1;
+    }
+    stats.mean_probes = (double)total / stats.size;
+    stats.hash_collisions = count_collisions(hashes);
+    stats.mean_miss_probes = mean_miss_probes(stats.buckets, [&table](size_t bucket) {
+        return table.bucket_size(bucket) > 0;
+    });
+    return stats;
+}
+
+
+template <class Hasher>
+ProbeStats probe_stats(const swiss::SwissTable<Locus, Records, Hasher>& table) {
+    // The same for a Swiss table, which probes whole groups: `buckets` are
+    // groups, probes count groups and a key is displaced when it is not in
+    // its home group; a miss ends at the first group with an EMPTY slot
+    ProbeStats stats;
+    stats.size = table.size();
+    stats.buckets = table.bucket_count() / swiss::GROUP_SIZE;
+    if (!stats.size) {
+        return stats;
+    }
+    const size_t mask = stats.buckets - 1;
+    const Hasher hasher = table.hash_function();
+    std::vector<size_t> hashes;
+    hashes.reserve(stats.size);
+    uint64_t total = 0;
+    for (auto it = table.begin(); it != table.end(); ++it) {
+        const size_t hash = hasher(it->first);
+        hashes.push_back(hash);
+        const size_t target = table.slot_of(it->first) / swiss::GROUP_SIZE;
+        size_t group = table.home_group_of(hash);
+        uint64_t probes = 0;
+        while (group != target) {
+            ++probes;
+            group = (group + probes) & mask;
+        }
+        if (stats.probes.size() <= probes) {
+            stats.probes.resize(probes + 1);
+        }
+        ++stats.probes[probes];
+        stats.displaced += probes > 0;
+        stats.max_probes = std::max(stats.max_probes, probes);
+        total += probes + 1;
+    }
+    stats.mean_probes = (double)total / stats.size;
+    stats.hash_collisions = count_collisions(hashes);
+    stats.mean_miss_probes = mean_miss_probes(stats.buckets, [&table](size_t group) {
+        return !table.group_has_empty(group);
+    });
+    return stats;
+}
+
+
+struct HashQuality {
+    // Quality of a hash function over a key set, measured on a simulated
+    // sparsepp table (power-of-two buckets, triangular probing) holding it
+    uint64_t size;
+    uint64_t buckets;
+    // occupancy of home buckets
+    uint64_t empty_buckets;
+    double expected_empty;      // for a random function: buckets * e^-load
+    uint64_t max_bucket_keys;
+    double uniformity;          // sum of n_b(n_b + 1)/2 relative to a random
+                                // function; 1 is ideal, larger is clustered
+    uint64_t hash_collisions;   // keys sharing their full hash with another
+    // probe lengths
+    uint64_t max_probes;
+    double mean_probes;
+    double mean_miss_probes;
+    std::vector<uint64_t> probes;   // number of keys by probe count
+    // avalanche: the probability that flipping one key bit flips an output
+    // bit, over sampled keys, every key bit and every output bit; ideally 0.5
+    uint64_t avalanche_keys;
+    double avalanche_mean;      // mean probability
+    double avalanche_bias;      // mean |p - 0.5|
+    double avalanche_worst;     // max |p - 0.5|
+    double index_worst;         // max |p - 0.5| over bucket index bits
+
+    HashQuality(): size(0), buckets(0), empty_buckets(0), expected_empty(0),
+                   max_bucket_keys(0), uniformity(0), hash_collisions(0),
+                   max_probes(0), mean_probes(0), mean_miss_probes(0),
+                   avalanche_keys(0), avalanche_mean(0), avalanche_bias(0),
+                   avalanche_worst(0), index_worst(0) {}
+};
+
+
+class HashAnalysis {
+    // Computes a HashQuality of a hash functor over packed keys
+
+private:
+
+    static const size_t KEYBITS = 56;       // bits used by Locus::pack
+    static const size_t HASHBITS = 8 * sizeof(size_t);
+    static const size_t AVALANCHE_SAMPLES = 2000;
+
+    const std::vector<uint64_t>& keys;
+    HashQuality& quality;
+
+    void occupancy(const std::vector<size_t>& hashes) {
+        const size_t mask = quality.buckets - 1;
+        std::vector<uint32_t> counts(quality.buckets, 0);
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            ++counts[hashes[i] & mask];
+        }
+        double sum = 0;
+        for (size_t b = 0; b < counts.size(); ++b) {
+            quality.empty_buckets += counts[b] == 0;
+            quality.max_bucket_keys = std::max<uint64_t>(quality.max_bucket_keys, counts[b]);
+            sum += (double)counts[b] * (counts[b] + 1) / 2;
+        }
+        const double n = (double)quality.size;
+        const double m = (double)quality.buckets;
+        quality.expected_empty = m * std::exp(-n / m);
+        quality.uniformity = sum / (n / (2 * m) * (n + 2 * m - 1));
+    }
+
+    void probing(const std::vector<size_t>& hashes) {
+        // insert every key in order, as sparsepp would without deletions;
+        // there are at most as many keys as buckets, and probing visits
+        // every bucket within `buckets` probes
+        const size_t mask = quality.buckets - 1;
+        std::vector<bool> occupied(quality.buckets, false);
+        uint64_t total = 0;
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            size_t bucket = hashes[i] & mask;
+            uint64_t probes = 0;
+            while (probes < mask && occupied[bucket]) {
+                ++probes;
+                bucket = (bucket + probes) & mask;
+            }
+            occupied[bucket] = true;
+            if (quality.probes.size() <= probes) {
+                quality.probes.resize(probes + 1);
+            }
+            ++quality.probes[probes];
+            quality.max_probes = std::max(quality.max_probes, probes);
+            total += probes + 1;
+        }
+        quality.mean_probes = (double)total / quality.size;
+        quality.mean_miss_probes = mean_miss_probes(quality.buckets, [&occupied](size_t bucket) {
+            return (bool)occupied[bucket];
+        });
+    }
+
+    template <class Hasher>
+    void avalanche(const Hasher& hasher, size_t samples) {
+        // flip each key bit of evenly spaced sample keys
+        samples = std::min(samples, keys.size());
+        std::vector<uint64_t> flips(KEYBITS * HASHBITS, 0);
+        for (size_t s = 0; s < samples; ++s) {
+            const uint64_t key = keys[s * keys.size() / samples];
+            const size_t hash = hasher(Locus::unpack(key));
+            for (size_t bit = 0; bit < KEYBITS; ++bit) {
+                size_t diff = hash ^ hasher(Locus::unpack(key ^ (uint64_t)1 << bit));
+                for (size_t out = 0; diff; ++out, diff >>= 1) {
+                    flips[bit * HASHBITS + out] += diff & 1;
+                }
+            }
+        }
+        quality.avalanche_keys = samples;
+        if (!samples) {
+            return;
+        }
+        const size_t indexbits = (size_t)__builtin_ctzll(quality.buckets);
+        double sum = 0;
+        double bias = 0;
+        for (size_t bit = 0; bit < KEYBITS; ++bit) {
+            for (size_t out = 0; out < HASHBITS; ++out) {
+                const double p = (double)flips[bit * HASHBITS + out] / samples;
+                const double deviation = std::fabs(p - 0.5);
+                sum += p;
+                bias += deviation;
+                quality.avalanche_worst = std::max(quality.avalanche_worst, deviation);
+                if (out < indexbits) {
+                    quality.index_worst = std::max(quality.index_worst, deviation);
+                }
+            }
+        }
+        quality.avalanche_mean = sum / (KEYBITS * HASHBITS);
+        quality.avalanche_bias = bias / (KEYBITS * HASHBITS);
+    }
+
+public:
+
+    HashAnalysis(const std::vector<uint64_t>& keys, HashQuality& quality):
+        keys(keys), quality(quality) {}
+
+    template <class Hasher>
+    void operator()(const Hasher& hasher) {
+        std::vector<size_t> hashes(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i) {
+            hashes[i] = hasher(Locus::unpack(keys[i]));
+        }
+        occupancy(hashes);
+        probing(hashes);
+        quality.hash_collisions = count_collisions(hashes);
+        avalanche(hasher, AVALANCHE_SAMPLES);
+    }
+};
+
+
+inline HashQuality hash_quality(const std::vector<uint64_t>& keys,
+                                LocusHasher hasher, double load_factor) {
+    // Measure `hasher` over packed `keys` in a table of the smallest power
+    // of two of buckets keeping the load at or below `load_factor`
+    if (!(load_factor > 0 && load_factor <= 1)) {
+        throw std::invalid_argument("load factor must be in (0, 1]");
+    }
+    HashQuality quality;
+    quality.size = keys.size();
+    quality.buckets = 1;
+    while (quality.buckets * load_factor < quality.size) {
+        quality.buckets <<= 1;
+    }
+    if (!keys.empty()) {
+        with_hasher(hasher, HashAnalysis(keys, quality));
+    }
+    return quality;
+}
+
+
+inline std::vector<uint64_t> packed_keys(const LocusTable& table, const FrozenTable& frozen) {
+    // The packed keys of a mapping, from whichever table holds them
+    std::vector<uint64_t> keys;
+    keys.reserve(table.size() + frozen.size());
+    for (LocusTable::const_iterator it = table.begin(); it != table.end(); ++it) {
+        keys.push_back(it->first.pack());
+    }
+    for (size_t i = 0; i < frozen.size(); ++i) {
+        keys.push_back(frozen.key(i));
+    }
+    return keys;
+}
+
+
+#endif
@@ -0,0 +1,630 @@
+#ifndef swiss_h
+#define swiss_h
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <utility>
+#include "multiply.hpp"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+// An open-addressing hash table in the style of Abseil's Swiss tables, the
+// alternative LocusTable backend (see mapping.hpp). Every slot has a control
+// byte: EMPTY, DELETED or, when full, the low 7 bits of its key's hash (H2).
+// Slots come in groups of 16; the other hash bits (H1) pick the group a
+// lookup starts from, whose 16 control bytes are matched against H2 with one
+// SSE2 compare so that only candidate slots are touched, and groups are
+// probed triangularly until one with an EMPTY byte. Compared to sparsepp's
+// sparse_hash_map there is no bitmap and slot array per group to go through,
+// but the slot array is allocated for the whole capacity, so lookups are
+// faster and the table is larger. SwissTable implements the subset of the
+// sparse_hash_map interface annogen relies on.
+
+
+namespace swiss {
+
+
+typedef int8_t ctrl_t;
+
+static const ctrl_t EMPTY = -128;
+static const ctrl_t DELETED = -2;
+static const ctrl_t SENTINEL = -1;     // ends iteration, after the last slot
+static const size_t GROUP_SIZE = 16;
+
+
+inline uint32_t lowest_bit(uint32_t bits) {
+    return (uint32_t)__builtin_ctz(bits);
+}
+
+
+struct Group {
+    // The control bytes of a group; each match returns a bitmask of the
+    // matching slots (bit i for slot i)
+
+#if defined(__SSE2__)
+    __m128i ctrl;
+
+    explicit Group(const ctrl_t* pos): ctrl(_mm_load_si128((const __m128i*)pos)) {}
+
+    uint32_t match(ctrl_t h2) const {
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl));
+    }
+
+    uint32_t match_empty() const {
+        return match(EMPTY);
+    }
+
+    uint32_t match_free() const {
+        // EMPTY or DELETED, the only bytes below SENTINEL
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(SENTINEL), ctrl));
+    }
+#else
+    const ctrl_t* ctrl;
+
+    explicit Group(const ctrl_t* pos): ctrl(pos) {}
+
+    uint32_t match(ctrl_t h2) const {
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GROUP_SIZE; ++i) {
+            bits |= (uint32_t)(ctrl[i] == h2) << i;
+        }
+        return bits;
+    }
+
+    uint32_t match_empty() const {
+        return match(EMPTY);
+    }
+
+    uint32_t match_free() const {
+        uint32_t bits = 0;
+        for (size_t i = 0; i < GROUP_SIZE; ++i) {
+            bits |= (uint32_t)(ctrl[i] < SENTINEL) << i;
+        }
+        return bits;
+    }
+#endif
+};
+
+
+template <class Key, class Value, class Hasher, class Equal>
+class SwissTable;
+
+
+template <class Item>
+class Iterator {
+    // Walks the full slots; a const_iterator when Item is const
+
+    template <class, class, class, class> friend class SwissTable;
+    template <class> friend class Iterator;
+
+private:
+
+    const ctrl_t* ctrl;
+    Item* slot;
+
+    void skip() {
+        while (*ctrl < SENTINEL) {
+            ++ctrl;
+            ++slot;
+        }
+    }
+
+public:
+
+    Iterator(): ctrl(nullptr), slot(nullptr) {}
+
+    Iterator(const ctrl_t* ctrl, Item* slot): ctrl(ctrl), slot(slot) {}
+
+    template <class Other>
+    Iterator(const Iterator<Other>& other): ctrl(other.ctrl), slot(other.slot) {}
+
+    Item& operator*() const {
+        return *slot;
+    }
+
+    Item* operator->() const {
+        return slot;
+    }
+
+    Iterator& operator++() {
+        ++ctrl;
+        ++slot;
+        skip();
+        return *this;
+    }
+
+    Iterator operator++(int) {
+        Iterator current = *this;
+        ++*this;
+        return current;
+    }
+
+    template <class Other>
+    bool operator==(const Iterator<Other>& other) const {
+        return slot == other.slot;
+    }
+
+    template <class Other>
+    bool operator!=(const Iterator<Other>& other) const {
+        return slot != other.slot;
+    }
+};
+
+
+template <class Key, class Value, class Hasher = std::hash<Key>,
+          class Equal = std::equal_to<Key> >
+class SwissTable {
+
+public:
+
+    typedef Key key_type;
+    typedef Value mapped_type;
+    typedef std::pair<const Key, Value> value_type;
+    typedef Hasher hasher;
+    typedef Equal key_equal;
+    typedef size_t size_type;
+    typedef Iterator<value_type> iterator;
+    typedef Iterator<const value_type> const_iterator;
+
+    static const size_t npos = (size_t)-1;
+
+private:
+
+    // one block: a control byte per slot and the sentinel, padded to a
+    // multiple of GROUP_SIZE, then the slots; groups never wrap around
+    void* block;
+    ctrl_t* ctrl;
+    value_type* slots;
+    size_t capacity;
+    size_t nitems;
+    size_t ndeleted;
+    size_t growth_limit;    // insertions into EMPTY slots before a rehash
+    float max_load;
+    float min_load;
+    bool shrinkable;        // something was erased since the last rehash
+    Hasher hashfn;
+    Equal equal;
+
+    static size_t mix(size_t hash) {
+        // Fold the hash through a 128-bit multiply before splitting it, as
+        // H2 takes its low bits, which are weak in some hashes (e.g. spp's
+        // hash_combine, whose low bits mostly come from the last field)
+        uint64_t high;
+        const uint64_t low = mul128(hash, 0x9e3779b97f4a7c15ULL, high);
+        return (size_t)(low ^ high);
+    }
+
+    static ctrl_t h2(size_t mixed) {
+        return (ctrl_t)(mixed & 0x7f);
+    }
+
+    size_t home_group(size_t mixed) const {
+        return (mixed >> 7) & (capacity / GROUP_SIZE - 1);
+    }
+
+    size_t next_group(size_t group, size_t& step) const {
+        return (group + ++step) & (capacity / GROUP_SIZE - 1);
+    }
+
+    static size_t ctrl_bytes(size_t capacity) {
+        return (capacity + GROUP_SIZE) & ~(GROUP_SIZE - 1);
+    }
+
+    size_t limit_of(size_t capacity) const {
+        // keep at least one EMPTY slot so that every probe sequence ends
+        const size_t limit = (size_t)(capacity * (double)max_load);
+        return capacity ? std::min(limit, capacity - 1) : 0;
+    }
+
+    size_t capacity_for(size_t n) const {
+        if (!n) {
+            return 0;
+        }
+        size_t capacity = GROUP_SIZE;
+        while (limit_of(capacity) < n) {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    void allocate(size_t n) {
+        capacity = n;
+        nitems = ndeleted = 0;
+        shrinkable = false;
+        growth_limit = limit_of(n);
+        if (!n) {
+            block = nullptr;
+            ctrl = nullptr;
+            slots = nullptr;
+            return;
+        }
+        const size_t ctrl_size = ctrl_bytes(n);
+        const size_t align = std::max(alignof(value_type), GROUP_SIZE);
+        const size_t offset = (ctrl_size + alignof(value_type) - 1) & ~(alignof(value_type) - 1);
+        if (posix_memalign(&block, align, offset + n * sizeof(value_type))) {
+            throw std::bad_alloc();
+        }
+        ctrl = (ctrl_t*)block;
+        slots = (value_type*)((char*)block + offset);
+        std::memset(ctrl, EMPTY, ctrl_size);
+        ctrl[n] = SENTINEL;
+    }
+
+    void destroy() {
+        for (size_t i = 0; i < capacity; ++i) {
+            if (ctrl[i] >= 0) {
+                slots[i].~value_type();
+            }
+        }
+        std::free(block);
+    }
+
+    size_t find_slot(const Key& key, size_t hash) const {
+        if (!capacity) {
+            return npos;
+        }
+        const size_t mixed = mix(hash);
+        const ctrl_t tag = h2(mixed);
+        size_t group = home_group(mixed);
+        size_t step = 0;
+        while (true) {
+            const size_t base = group * GROUP_SIZE;
+            const Group bytes(ctrl + base);
+            for (uint32_t match = bytes.match(tag); match; match &= match - 1) {
+                const size_t i = base + lowest_bit(match);
+                if (__builtin_expect(equal(slots[i].first, key), 1)) {
+                    return i;
+                }
+            }
+            if (__builtin_expect(bytes.match_empty() != 0, 1)) {
+                return npos;
+            }
+            group = next_group(group, step);
+        }
+    }
+
+    size_t find_free(size_t hash) const {
+        // The first EMPTY or DELETED slot of the probe sequence of `hash`
+        size_t group = home_group(mix(hash));
+        size_t step = 0;
+        while (true) {
+            const uint32_t free = Group(ctrl + group * GROUP_SIZE).match_free();
+            if (free) {
+                return group * GROUP_SIZE + lowest_bit(free);
+            }
+            group = next_group(group, step);
+        }
+    }
+
+    void rehash(size_t n) {
+        // Move the items to a table of `n` slots, dropping tombstones
+        SwissTable moved(hashfn, equal, max_load, min_load);
+        moved.allocate(n);
+        for (size_t i = 0; i < capacity; ++i) {
+            if (ctrl[i] >= 0) {
+                const size_t h = hashfn(slots[i].first);
+                const size_t target = moved.find_free(h);
+                new (moved.slots + target) value_type(std::move(slots[i]));
+                moved.ctrl[target] = h2(mix(h));
+                ++moved.nitems;
+            }
+        }
+        moved.growth_limit -= moved.nitems;
+        swap(moved);
+    }
+
+    void grow() {
+        // Out of EMPTY slots: purge tombstones in place when they make up a
+        // good share of the table, double it otherwise
+        if (capacity && ndeleted >= capacity / 4) {
+            rehash(capacity);
+        } else {
+            rehash(std::max(capacity * 2, capacity_for(nitems + 1)));
+        }
+    }
+
+    void maybe_shrink() {
+        shrinkable = false;
+        if (capacity > GROUP_SIZE && nitems < capacity * (double)min_load) {
+            rehash(std::max(capacity_for(nitems), GROUP_SIZE));
+        }
+    }
+
+    std::pair<size_t, bool> find_or_prepare(const Key& key, size_t hash) {
+        // The slot of `key`, or a free slot claimed for it (to be constructed
+        // by the caller) and true
+        size_t i = find_slot(key, hash);
+        if (i != npos) {
+            return std::make_pair(i, false);
+        }
+        if (shrinkable) {
+            maybe_shrink();
+        }
+        if (!capacity) {
+            allocate(GROUP_SIZE);
+        }
+        i = find_free(hash);
+        if (ctrl[i] == EMPTY && !growth_limit) {
+            grow();
+            i = find_free(hash);
+        }
+        if (ctrl[i] == DELETED) {
+            --ndeleted;
+        } else {
+            --growth_limit;
+        }
+        ctrl[i] = h2(mix(hash));
+        ++nitems;
+        return std::make_pair(i, true);
+    }
+
+    SwissTable(const Hasher& hash, const Equal& equal, float max_load, float min_load):
+        block(nullptr), ctrl(nullptr), slots(nullptr), capacity(0), nitems(0),
+        ndeleted(0), growth_limit(0), max_load(max_load), min_load(min_load),
+        shrinkable(false), hashfn(hash), equal(equal) {}
+
+public:
+
+    explicit SwissTable(size_t n = 0, const Hasher& hash = Hasher(),
+                        const Equal& equal = Equal()):
+        SwissTable(hash, equal, 0.875f, 0.0f) {
+        reserve(n);
+    }
+
+    SwissTable(const SwissTable& other):
+        SwissTable(other.hashfn, other.equal, other.max_load, other.min_load) {
+        reserve(other.nitems);
+        for (const_iterator it = other.begin(); it != other.end(); ++it) {
+            insert(*it);
+        }
+    }
+
+    SwissTable(SwissTable&& other):
+        SwissTable(other.hashfn, other.equal, other.max_load, other.min_load) {
+        swap(other);
+    }
+
+    SwissTable& operator=(SwissTable other) {
+        swap(other);
+        return *this;
+    }
+
+    ~SwissTable() {
+        if (block) {
+            destroy();
+        }
+    }
+
+    void swap(SwissTable& other) {
+        std::swap(block, other.block);
+        std::swap(ctrl, other.ctrl);
+        std::swap(slots, other.slots);
+        std::swap(capacity, other.capacity);
+        std::swap(nitems, other.nitems);
+        std::swap(ndeleted, other.ndeleted);
+        std::swap(growth_limit, other.growth_limit);
+        std::swap(max_load, other.max_load);
+        std::swap(min_load, other.min_load);
+        std::swap(shrinkable, other.shrinkable);
+        std::swap(hashfn, other.hashfn);
+        std::swap(equal, other.equal);
+    }
+
+    iterator begin() {
+        if (!capacity) {
+            return end();
+        }
+        iterator it(ctrl, slots);
+        it.skip();
+        return it;
+    }
+
+    iterator end() {
+        return iterator(ctrl + capacity, slots + capacity);
+    }
+
+    const_iterator begin() const {
+        return const_cast<SwissTable*>(this)->begin();
+    }
+
+    const_iterator end() const {
+        return const_cast<SwissTable*>(this)->end();
+    }
+
+    size_t size() const {
+        return nitems;
+    }
+
+    bool empty() const {
+        return !nitems;
+    }
+
+    size_t bucket_count() const {
+        return capacity;
+    }
+
+    float load_factor() const {
+        return capacity ? (float)nitems / capacity : 0.0f;
+    }
+
+    float max_load_factor() const {
+        return max_load;
+    }
+
+    void max_load_factor(float grow) {
+        max_load = grow;
+        if (capacity && limit_of(capacity) < nitems + ndeleted) {
+            rehash(capacity_for(nitems));
+        } else if (capacity) {
+            growth_limit = limit_of(capacity) - nitems - ndeleted;
+        }
+    }
+
+    float min_load_factor() const {
+        return min_load;
+    }
+
+    void min_load_factor(float shrink) {
+        min_load = shrink;
+    }
+
+    void set_resizing_parameters(float shrink, float grow) {
+        // like sparsepp, clip `shrink` so that a shrunk table does not grow
+        // again right away (here to a quarter of `grow`)
+        max_load_factor(grow);
+        min_load_factor(std::min(shrink, grow / 4));
+    }
+
+    hasher hash_function() const {
+        return hashfn;
+    }
+
+    key_equal key_eq() const {
+        return equal;
+    }
+
+    void reserve(size_t n) {
+        // Make room for `n` items without rehashing
+        if (n > nitems && limit_of(capacity) < n) {
+            rehash(capacity_for(n));
+        }
+    }
+
+    void resize(size_t n) {
+        // Rehash to the smallest capacity holding max(n, size()) items: like
+        // sparsepp, resize(0) shrinks the table to fit
+        const size_t fit = capacity_for(std::max(n, nitems));
+        if (fit != capacity || ndeleted) {
+            rehash(fit);
+        }
+    }
+
+    void clear() {
+        SwissTable(hashfn, equal, max_load, min_load).swap(*this);
+    }
+
+    void prefetch(size_t hash, bool items) const {
+        // Prefetch the control bytes (or the slots) of the first group
+        // probed for `hash`
+        if (capacity) {
+            const size_t base = home_group(mix(hash)) * GROUP_SIZE;
+            if (items) {
+                __builtin_prefetch(slots + base);
+            } else {
+                __builtin_prefetch(ctrl + base);
+            }
+        }
+    }
+
+    const_iterator find_hashed(const Key& key, size_t hash) const {
+        const size_t i = find_slot(key, hash);
+        return i == npos ? end() : const_iterator(ctrl + i, slots + i);
+    }
+
+    iterator find_hashed(const Key& key, size_t hash) {
+        const size_t i = find_slot(key, hash);
+        return i == npos ? end() : iterator(ctrl + i, slots + i);
+    }
+
+    const_iterator find(const Key& key) const {
+        return find_hashed(key, hashfn(key));
+    }
+
+    iterator find(const Key& key) {
+        return find_hashed(key, hashfn(key));
+    }
+
+    bool contains(const Key& key) const {
+        return find_slot(key, hashfn(key)) != npos;
+    }
+
+    size_t count(const Key& key) const {
+        return contains(key);
+    }
+
+    Value& find_or_insert_hashed(const Key& key, size_t hash) {
+        // operator[] with a precomputed hash, for batched inserts
+        const std::pair<size_t, bool> slot = find_or_prepare(key, hash);
+        if (slot.second) {
+            new (slots + slot.first) value_type(key, Value());
+        }
+        return slots[slot.first].second;
+    }
+
+    Value& operator[](const Key& key) {
+        return find_or_insert_hashed(key, hashfn(key));
+    }
+
+    std::pair<iterator, bool> insert(const value_type& item) {
+        const std::pair<size_t, bool> slot = find_or_prepare(item.first, hashfn(item.first));
+        if (slot.second) {
+            new (slots + slot.first) value_type(item);
+        }
+        return std::make_pair(iterator(ctrl + slot.first, slots + slot.first), slot.second);
+    }
+
+    size_t erase(const Key& key) {
+        const size_t i = find_slot(key, hashfn(key));
+        if (i == npos) {
+            return 0;
+        }
+        slots[i].~value_type();
+        --nitems;
+        shrinkable = true;
+        // a slot may become EMPTY again only if no probe sequence went on
+        // past its group, i.e. the group has an EMPTY slot
+        const size_t base = i & ~(GROUP_SIZE - 1);
+        if (Group(ctrl + base).match_empty()) {
+            ctrl[i] = EMPTY;
+            ++growth_limit;
+        } else {
+            ctrl[i] = DELETED;
+            ++ndeleted;
+        }
+        return 1;
+    }
+
+    // introspection, for stats.hpp and memory.hpp
+
+    size_t slot_of(const Key& key) const {
+        // The slot holding `key`, or npos
+        return find_slot(key, hashfn(key));
+    }
+
+    size_t home_group_of(size_t hash) const {
+        return home_group(mix(hash));
+    }
+
+    bool group_has_empty(size_t group) const {
+        return Group(ctrl + group * GROUP_SIZE).match_empty() != 0;
+    }
+
+    size_t deleted() const {
+        return ndeleted;
+    }
+
+    const void* allocation() const {
+        return block;
+    }
+
+    size_t allocated_bytes() const {
+        return capacity ? (char*)(slots + capacity) - (char*)block : 0;
+    }
+
+    size_t control_bytes() const {
+        return capacity ? (char*)slots - (char*)block : 0;
+    }
+};
+
+
+}   // namespace swiss
+
+
+#endif
@@ -0,0 +1,320 @@
+"""
+Deterministic synthetic variant annotations for load, scaling and benchmark
+runs. Variants are generated contig by contig in genomic order, in chunks,
+so any number of them (up to ~10^9) can be streamed in constant memory:
+
+    genome = SyntheticGenome(10 ** 6, seed=1)
+    mapping = genome.mapping()              # a GenomeMapping
+    for (contig, pos, ref, alt), annotations in genome.entries():
+        ...
+    genome.write_vcf(open('synthetic.vcf', 'w'))
+
+The same seed and parameters always give the same variants: every chunk has
+its own random generator seeded from (seed, contig, chunk). Requires NumPy.
+
+Or from the command line:
+
+    python -m annogen.synthetic 1000000 --seed 1 --format tsv > out.tsv
+"""
+
+import argparse
+import sys
+from typing import Dict, Iterator, List, NamedTuple, Optional, TextIO, Tuple
+
+import numpy as np
+
+BASES = 'ACGT'
+CHUNK = 65536  # loci per generated chunk
+
+# GRCh38 primary assembly
+GRCH38 = {
+    '1': 248956422, '2': 242193529, '3': 198295559, '4': 190214555,
+    '5': 181538259, '6': 170805979, '7': 159345973, '8': 145138636,
+    '9': 138394717, '10': 133797422, '11': 135086622, '12': 133275309,
+    '13': 114364328, '14': 107043718, '15': 101991189, '16': 90338345,
+    '17': 83257441, '18': 80373285, '19': 58617616, '20': 64444167,
+    '21': 46709983, '22': 50818468, 'X': 156040895, 'Y': 57227415,
+    'MT': 16569
+}
+
+Site = Tuple[str, int, str, str]
+
+
+class FeatureModel(NamedTuple):
+    """
+    How to generate the values of a feature
+    :param dtype: int, float or str
+    :param cardinality: the number of distinct strings (str only); string
+    frequencies are skewed, so a few strings are very common and most rare
+    :param count: the number of values per locus
+    :param missing: the share of loci without the feature
+    :param cached: whether GenomeMapping should cache the strings
+    """
+    dtype: type
+    cardinality: Optional[int] = None
+    count: int = 1
+    missing: float = 0.0
+    cached: bool = False
+
+
+# a mix resembling a typical annotation source
+DEFAULT_FEATURES = {
+    'AF': FeatureModel(float),
+    'AC': FeatureModel(int),
+    'DP': FeatureModel(int, missing=0.2),
+    'gene': FeatureModel(str, cardinality=20000, missing=0.5),
+    'consequence': FeatureModel(str, cardinality=40, count=2, cached=True),
+    'clinsig': FeatureModel(str, cardinality=8, missing=0.95, cached=True),
+    'scores': FeatureModel(float, count=4, missing=0.3)
+}
+
+
+class Chunk(NamedTuple):
+    """
+    Loci of a single contig in genomic order. Empty alleles (single-base
+    insertions and deletions) are b''. Values of a feature are an array
+    of shape (loci, count) with `present` marking loci that have them.
+    """
+    contig: str
+    positions: np.ndarray             # uint32, 1-based
+    refs: np.ndarray                  # S1
+    alts: np.ndarray                  # S1
+    values: Dict[str, np.ndarray]
+    present: Dict[str, np.ndarray]    # bool
+
+    def __len__(self):
+        return len(self.positions)
+
+
+class SyntheticGenome:
+
+    def __init__(self, nvariants: int, seed: int = 0,
+                 contigs: Optional[Dict[str, int]] = None,
+                 snv_fraction: float = 0.9,
+                 features: Optional[Dict[str, FeatureModel]] = None):
+        """
+        :param nvariants: the number of variants; they are spread over
+        contigs in proportion to contig lengths
+        :param seed: random seed
+        :param contigs: a mapping from contig names to lengths; GRCh38 if None
+        :param snv_fraction: the share of SNVs; the rest are equally split
+        between single-base insertions and deletions
+        :param features: feature models; DEFAULT_FEATURES if None
+        """
+        self.nvariants = nvariants
+        self.seed = seed
+        self.lengths = dict(GRCH38 if contigs is None else contigs)
+        self.snv_fraction = snv_fraction
+        self.models = dict(DEFAULT_FEATURES if features is None else features)
+        if any(model.dtype not in (int, float, str)
+               for model in self.models.values()):
+            raise TypeError('dtype must be int, float or str')
+        if any(model.dtype is str and not model.cardinality
+               for model in self.models.values()):
+            raise ValueError('string features need a cardinality')
+        self.counts = self.allocate()
+
+    def allocate(self) -> List[int]:
+        # split variants between contigs proportionally to their lengths
+        # (largest remainders get the leftovers); no randomness involved
+        lengths = list(self.lengths.values())
+        total = sum(lengths)
+        exact = [self.nvariants * length / total for length in lengths]
+        counts = [int(share) for share in exact]
+        leftover = self.nvariants - sum(counts)
+        order = sorted(range(len(exact)), key=lambda i: counts[i] - exact[i])
+        for i in order[:leftover]:
+            counts[i] += 1
+        return counts
+
+    @property
+    def contigs(self) -> List[str]:
+        return list(self.lengths)
+
+    @property
+    def alphabet(self) -> str:
+        return BASES
+
+    @property
+    def features(self) -> Dict[str, type]:
+        return {name: model.dtype for name, model in self.models.items()}
+
+    @property
+    def cached(self) -> List[str]:
+        return [name for name, model in self.models.items() if model.cached]
+
+    def __len__(self):
+        return self.nvariants
+
+    def mapping(self, **kwargs):
+        """
+        Build a GenomeMapping of all variants
+        :param kwargs: passed on to GenomeMapping
+        """
+        from annogen.mapping import GenomeMapping
+        kwargs.setdefault('expected_size', self.nvariants)
+        return GenomeMapping(self.features, self.contigs, self.alphabet,
+                             self.cached, self.entries(), **kwargs)
+
+    def chunks(self) -> Iterator[Chunk]:
+        for index, (contig, length) in enumerate(self.lengths.items()):
+            count = self.counts[index]
+            # positions form a Bernoulli process along the contig
+            rate = min(1.0, count / length)
+            position = 0
+            for first in range(0, count, CHUNK):
+                rng = np.random.default_rng([self.seed, index, first // CHUNK])
+                chunk = self.chunk(rng, index, contig, position,
+                                   min(CHUNK, count - first), rate)
+                position = int(chunk.positions[-1])
+                yield chunk
+
+    def chunk(self, rng: np.random.Generator, index: int, contig: str,
+              start: int, size: int, rate: float) -> Chunk:
+        positions = start + np.cumsum(rng.geometric(rate, size),
+                                      dtype=np.uint64)
+        positions = positions.astype(np.uint32)
+        reference = self.reference(index, positions)
+        kinds = rng.random(size)
+        indel = (1 - self.snv_fraction) / 2
+        # SNVs: any base but the reference one
+        alts = (reference + rng.integers(1, 4, size, dtype=np.uint8)) % 4
+        bases = np.frombuffer(BASES.encode(), dtype='S1')
+        refs = bases[reference]
+        alts = bases[alts]
+        insertions = kinds >= 1 - 2 * indel
+        deletions = kinds >= 1 - indel
+        refs[insertions & ~deletions] = b''
+        alts[deletions] = b''
+        values = {}
+        present = {}
+        for name, model in self.models.items():
+            present[name] = rng.random(size) >= model.missing
+            shape = (size, model.count)
+            if model.dtype is float:
+                # log-uniform, like allele frequencies
+                values[name] = 10 ** rng.uniform(-6, 0, shape)
+            elif model.dtype is int:
+                values[name] = rng.poisson(30, shape)
+            else:
+                # skewed: the i-th string has probability ~ 1 / (i + 1)
+                draws = model.cardinality ** rng.random(shape)
+                values[name] = draws.astype(np.int64) - 1
+        return Chunk(contig, positions, refs, alts, values, present)
+
+    @staticmethod
+    def reference(index: int, positions: np.ndarray) -> np.ndarray:
+        # a pseudo-random reference base for each position, the same for all
+        # variants and chunks touching it
+        mixed = (positions.astype(np.uint64) ^ np.uint64(index << 32)) * \
+            np.uint64(0x9e3779b97f4a7c15)
+        return (mixed >> np.uint64(62)).astype(np.uint8)
+
+    def decode(self, chunk: Chunk) -> List[Dict[str, list]]:
+        """
+        Convert the values of a chunk into GenomeMapping annotations
+        """
+        annotations = [{} for _ in range(len(chunk))]
+        for name, model in self.models.items():
+            values = chunk.values[name].tolist()
+            for i in np.flatnonzero(chunk.present[name]).tolist():
+                annotations[i][name] = (
+                    [f'{name}{value}' for value in values[i]]
+                    if model.dtype is str else values[i]
+                )
+        return annotations
+
+    def sites(self) -> Iterator[Site]:
+        for chunk in self.chunks():
+            contig = chunk.contig
+            for pos, ref, alt in zip(chunk.positions.tolist(),
+                                     chunk.refs.tolist(), chunk.alts.tolist()):
+                yield contig, pos, ref.decode(), alt.decode()
+
+    def entries(self) -> Iterator[Tuple[Site, Dict[str, list]]]:
+        """
+        Stream ((contig, pos, ref, alt), annotations) pairs, the input of
+        GenomeMapping and GenomeMapping.insert_many
+        """
+        for chunk in self.chunks():
+            contig = chunk.contig
+            loci = zip(chunk.positions.tolist(), chunk.refs.tolist(),
+                       chunk.alts.tolist())
+            for (pos, ref, alt), annotations in zip(loci, self.decode(chunk)):
+                yield (contig, pos, ref.decode(), alt.decode()), annotations
+
+    def write_tsv(self, out: TextIO):
+        """
+        Write a header and a line per variant: contig, pos, ref, alt (an
+        empty allele is '-') and a column per feature (values separated by
+        commas, '.' if missing)
+        """
+        out.write('\t'.join(['#contig', 'pos', 'ref', 'alt'] +
+                            list(self.models)) + '\n')
+        for (contig, pos, ref, alt), annotations in self.entries():
+            fields = [contig, str(pos), ref or '-', alt or '-']
+            fields.extend(','.join(map(str, annotations[name]))
+                          if name in annotations else '.'
+                          for name in self.models)
+            out.write('\t'.join(fields) + '\n')
+
+    def write_vcf(self, out: TextIO):
+        """
+        Write a sites-only VCF with features as INFO fields. VCF anchors
+        indels to the preceding base, so a deletion at `pos` is written at
+        pos - 1 (or anchored to the next base at the start of a contig) and
+        an insertion is written after `pos`; anchor bases are the
+        pseudo-random reference bases.
+        """
+        types = {int: 'Integer', float: 'Float', str: 'String'}
+        out.write('##fileformat=VCFv4.2\n')
+        out.write('##source=annogen.synthetic seed={}\n'.format(self.seed))
+        for contig, length in self.lengths.items():
+            out.write(f'##contig=<ID={contig},length={length}>\n')
+        for name, model in self.models.items():
+            out.write(f'##INFO=<ID={name},Number={model.count},'
+                      f'Type={types[model.dtype]},Description="synthetic">\n')
+        out.write('#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n')
+        for chunk in self.chunks():
+            contig = chunk.contig
+            contig_index = self.contigs.index(contig)
+            reference = self.reference(contig_index, chunk.positions)
+            previous = self.reference(contig_index, chunk.positions - 1)
+            following = self.reference(contig_index, chunk.positions + 1)
+            rows = zip(chunk.positions.tolist(), chunk.refs.tolist(),
+                       chunk.alts.tolist(), reference.tolist(),
+                       previous.tolist(), following.tolist(),
+                       self.decode(chunk))
+            for pos, ref, alt, base, before, after, annotations in rows:
+                ref, alt = ref.decode(), alt.decode()
+                if not alt and pos == 1:
+                    ref, alt = ref + BASES[after], BASES[after]
+                elif not alt:
+                    pos, ref, alt = pos - 1, BASES[before] + ref, BASES[before]
+                elif not ref:
+                    ref, alt = BASES[base], BASES[base] + alt
+                info = ';'.join(
+                    f'{name}={",".join(map(str, values))}'
+                    for name, values in annotations.items()
+                ) or '.'
+                out.write(f'{contig}\t{pos}\t.\t{ref}\t{alt}\t.\t.\t{info}\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Write synthetic variant annotations to stdout')
+    parser.add_argument('nvariants', type=int)
+    parser.add_argument('--seed', type=int, default=0)
+    parser.add_argument('--snv-fraction', type=float, default=0.9)
+    parser.add_argument('--format', choices=['tsv', 'vcf'], default='vcf')
+    args = parser.parse_args()
+    genome = SyntheticGenome(args.nvariants, args.seed,
+                             snv_fraction=args.snv_fraction)
+    if args.format == 'vcf':
+        genome.write_vcf(sys.stdout)
+    else:
+        genome.write_tsv(sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
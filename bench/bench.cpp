@@ -0,0 +1,552 @@
+// Micro benchmarks of the C++ core: table inserts, single and batched
+// lookups (mutable and frozen), hash policies, record decoding per feature
+// kind, string interning, memory per locus and the two table backends. All inputs are generated deterministically
+// from a seed, so runs are comparable across changes. See Makefile.
+
+#include <benchmark/benchmark.h>
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <vector>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "mapping.hpp"
+#include "records.hpp"
+#include "filter.hpp"
+#include "frozen.hpp"
+#include "batch.hpp"
+#include "hashing.hpp"
+#include "swiss.hpp"
+
+
+static const uint64_t SEED = 42;
+static const size_t QUERIES = 1 << 16;  // loci looked up per iteration batch
+
+
+struct Random {
+    // splitmix64: unlike std:: distributions, identical on every platform
+    uint64_t state;
+
+    explicit Random(uint64_t seed): state(seed) {}
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t below(uint64_t bound) {
+        return (uint64_t)(((unsigned __int128)next() * bound) >> 64);
+    }
+};
+
+
+// GRCh38 primary assembly lengths (1-22, X, Y) in Mbp: contigs are drawn in
+// proportion to their length
+static const uint32_t CONTIG_MBP[] = {
+    248, 242, 198, 190, 181, 171, 159, 145, 138, 134, 135, 133,
+    114, 107, 102, 90, 83, 80, 59, 64, 47, 51, 156, 57
+};
+static const size_t NCONTIGS = sizeof(CONTIG_MBP) / sizeof(CONTIG_MBP[0]);
+
+
+static std::vector<Locus> make_loci(size_t n, uint64_t seed) {
+    // Distinct-enough random variants: ~90% SNVs, the rest insertions or
+    // deletions (an empty allele, base code 0); bases are codes 1-4
+    Random random(seed);
+    uint32_t total = 0;
+    for (size_t i = 0; i < NCONTIGS; ++i) {
+        total += CONTIG_MBP[i];
+    }
+    std::vector<Locus> loci;
+    loci.reserve(n);
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t pick = random.below(total);
+        uint8_t contig = 0;
+        while (pick >= CONTIG_MBP[contig]) {
+            pick -= CONTIG_MBP[contig++];
+        }
+        const uint32_t pos = (uint32_t)random.below((uint64_t)CONTIG_MBP[contig] * 1000000);
+        const char ref = (char)(1 + random.below(4));
+        char alt = (char)(1 + (ref + random.below(3)) % 4);
+        const uint64_t kind = random.below(10);
+        if (kind == 0) {
+            alt = 0;
+        }
+        loci.push_back(Locus(contig, pos, kind == 1 ? (char)0 : ref, alt));
+    }
+    return loci;
+}
+
+
+static std::vector<Locus> make_misses(const std::vector<Locus>& loci) {
+    // Loci absent from a table built over `loci`: contig codes above the
+    // generated ones
+    std::vector<Locus> misses(loci);
+    for (size_t i = 0; i < misses.size(); ++i) {
+        misses[i].chrom = (uint8_t)(misses[i].chrom + NCONTIGS);
+    }
+    return misses;
+}
+
+
+static Records make_records(RecordsBuilder& builder, RecordArena& arena,
+                            Random& random) {
+    // A typical record: an allele frequency, a depth and a gene symbol
+    builder.begin(0, false);
+    builder.add_float((float)random.below(1000000) / 1000000);
+    builder.begin(1, false);
+    builder.add_integer((int32_t)random.below(10000));
+    builder.begin(2, true);
+    builder.add_string("GENE" + std::to_string(random.below(20000)));
+    return builder.finish(arena);
+}
+
+
+struct Fixture {
+    std::vector<Locus> loci;
+    std::vector<Locus> misses;
+    RecordArena arena;
+    LocusTable table;
+
+    explicit Fixture(size_t n): loci(make_loci(n, SEED)), misses(make_misses(loci)) {
+        RecordsBuilder builder;
+        Random random(SEED + 1);
+        table.reserve(n);
+        for (size_t i = 0; i < n; ++i) {
+            table[loci[i]] = make_records(builder, arena, random);
+        }
+    }
+};
+
+
+static Fixture& fixture(size_t n) {
+    // Fixtures are expensive at scale, so they are built once per size
+    static std::vector<std::pair<size_t, Fixture*>> fixtures;
+    for (size_t i = 0; i < fixtures.size(); ++i) {
+        if (fixtures[i].first == n) {
+            return *fixtures[i].second;
+        }
+    }
+    fixtures.push_back(std::make_pair(n, new Fixture(n)));
+    return *fixtures.back().second;
+}
+
+
+static void BM_Insert(benchmark::State& state) {
+    const size_t n = (size_t)state.range(0);
+    const bool reserve = state.range(1);
+    const std::vector<Locus> loci = make_loci(n, SEED);
+    for (auto _ : state) {
+        LocusTable table;
+        if (reserve) {
+            table.reserve(n);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            table[loci[i]] = Records();
+        }
+        benchmark::DoNotOptimize(table.size());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_Insert)->ArgsProduct({{1 << 16, 1 << 20}, {0, 1}})
+                    ->ArgNames({"loci", "reserve"})->Unit(benchmark::kMillisecond);
+
+
+static void BM_InsertBatch(benchmark::State& state) {
+    const size_t n = (size_t)state.range(0);
+    const std::vector<Locus> loci = make_loci(n, SEED);
+    LocusBatch batch;
+    for (size_t i = 0; i < n; ++i) {
+        batch.push_back(loci[i].chrom, loci[i].pos, loci[i].ref, loci[i].alt);
+    }
+    std::vector<Records> records(n);
+    LocusFilter filter;
+    for (auto _ : state) {
+        LocusTable table;
+        table.reserve(n);
+        batch.pack(true);
+        insert_batch(table, filter, batch.keys.data(), batch.hashes.data(), n,
+                     records.data());
+        benchmark::DoNotOptimize(table.size());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_InsertBatch)->Arg(1 << 16)->Arg(1 << 20)->ArgName("loci")
+                         ->Unit(benchmark::kMillisecond);
+
+
+static void lookup_single(benchmark::State& state, bool hits) {
+    Fixture& data = fixture((size_t)state.range(0));
+    const std::vector<Locus>& queries = hits ? data.loci : data.misses;
+    Random random(SEED + 2);
+    std::vector<Locus> order(QUERIES);
+    for (size_t i = 0; i < QUERIES; ++i) {
+        order[i] = queries[random.below(queries.size())];
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(lookup(data.table, order[i++ & (QUERIES - 1)]));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+
+static void BM_LookupHit(benchmark::State& state) {
+    lookup_single(state, true);
+}
+BENCHMARK(BM_LookupHit)->Arg(1 << 16)->Arg(1 << 20)->Arg(1 << 23)->ArgName("loci");
+
+
+static void BM_LookupMiss(benchmark::State& state) {
+    lookup_single(state, false);
+}
+BENCHMARK(BM_LookupMiss)->Arg(1 << 16)->Arg(1 << 20)->Arg(1 << 23)->ArgName("loci");
+
+
+static LocusBatch make_batch(const Fixture& data, uint64_t seed) {
+    // Half hits, half misses
+    Random random(seed);
+    LocusBatch batch;
+    for (size_t i = 0; i < QUERIES; ++i) {
+        const std::vector<Locus>& source = i % 2 ? data.misses : data.loci;
+        const Locus& locus = source[random.below(source.size())];
+        batch.push_back(locus.chrom, locus.pos, locus.ref, locus.alt);
+    }
+    return batch;
+}
+
+
+static void BM_LookupBatch(benchmark::State& state) {
+    Fixture& data = fixture((size_t)state.range(0));
+    LocusBatch batch = make_batch(data, SEED + 3);
+    LocusFilter filter;
+    if (state.range(1)) {
+        filter.init(data.table.size(), 0.01);
+        for (size_t i = 0; i < data.loci.size(); ++i) {
+            filter.insert(data.loci[i].pack());
+        }
+    }
+    std::vector<const Records*> out(QUERIES);
+    for (auto _ : state) {
+        batch.pack(true);
+        lookup_batch(data.table, filter, batch.keys.data(), batch.hashes.data(),
+                     QUERIES, out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * QUERIES);
+}
+BENCHMARK(BM_LookupBatch)->ArgsProduct({{1 << 16, 1 << 20, 1 << 23}, {0, 1}})
+                         ->ArgNames({"loci", "filter"});
+
+
+static void BM_FrozenLookupBatch(benchmark::State& state) {
+    const size_t n = (size_t)state.range(0);
+    Fixture& data = fixture(n);
+    LocusTable copy(data.table);
+    FrozenTable frozen;
+    frozen.build(copy, (FrozenIndex)state.range(1));
+    LocusBatch batch = make_batch(data, SEED + 3);
+    batch.pack(false);
+    LocusFilter filter;
+    std::vector<const Records*> out(QUERIES);
+    for (auto _ : state) {
+        lookup_batch(frozen, filter, batch.keys.data(), QUERIES, out.data());
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * QUERIES);
+}
+BENCHMARK(BM_FrozenLookupBatch)->ArgsProduct({{1 << 16, 1 << 20, 1 << 23},
+                                              {EYTZINGER, PERFECT_HASH}})
+                               ->ArgNames({"loci", "index"});
+
+
+template <class Hasher>
+static void BM_HashKeys(benchmark::State& state) {
+    // Hash throughput over packed keys
+    const std::vector<Locus> loci = make_loci(QUERIES, SEED);
+    std::vector<uint64_t> keys(QUERIES);
+    for (size_t i = 0; i < QUERIES; ++i) {
+        keys[i] = loci[i].pack();
+    }
+    std::vector<size_t> hashes(QUERIES);
+    for (auto _ : state) {
+        hash_keys<Hasher>(keys.data(), QUERIES, hashes.data());
+        benchmark::DoNotOptimize(hashes.data());
+    }
+    state.SetItemsProcessed(state.iterations() * QUERIES);
+}
+BENCHMARK_TEMPLATE(BM_HashKeys, SppLocusHash);
+BENCHMARK_TEMPLATE(BM_HashKeys, MixLocusHash);
+BENCHMARK_TEMPLATE(BM_HashKeys, Crc32cLocusHash);
+BENCHMARK_TEMPLATE(BM_HashKeys, WyLocusHash);
+BENCHMARK_TEMPLATE(BM_HashKeys, Xxh3LocusHash);
+
+
+template <class Hasher>
+static void hash_batch(const Hasher&, const LocusBatch& batch, size_t* hashes) {
+    hash_keys<Hasher>(batch.keys.data(), batch.size(), hashes);
+}
+
+
+static void hash_batch(const LocusHash& hasher, const LocusBatch& batch, size_t* hashes) {
+    hash_keys(hasher.hasher(), batch.keys.data(), batch.size(), hashes);
+}
+
+
+template <class Hasher>
+static void BM_HashLookup(benchmark::State& state) {
+    // Single lookups (hits) and batched ones (half misses) in a copy of the
+    // fixture table bound to `Hasher` at compile time; LocusHash is the
+    // runtime-dispatched default policy used by GenomeMapping
+    Fixture& data = fixture((size_t)state.range(0));
+    BasicLocusTable<Hasher> table;
+    table.reserve(data.table.size());
+    for (LocusTable::const_iterator it = data.table.begin(); it != data.table.end(); ++it) {
+        table.insert(*it);
+    }
+    const bool batched = state.range(1);
+    LocusBatch batch = make_batch(data, SEED + 3);
+    batch.pack(false);
+    std::vector<size_t> hashes(QUERIES);
+    std::vector<const Records*> out(QUERIES);
+    LocusFilter filter;
+    size_t i = 0;
+    for (auto _ : state) {
+        if (batched) {
+            hash_batch(table.hash_function(), batch, hashes.data());
+            lookup_batch(table, filter, batch.keys.data(), hashes.data(),
+                         QUERIES, out.data());
+            benchmark::DoNotOptimize(out.data());
+        } else {
+            const Locus& locus = data.loci[(i++ * 7919) % data.loci.size()];
+            typename BasicLocusTable<Hasher>::const_iterator it = table.find(locus);
+            benchmark::DoNotOptimize(it == table.end() ? nullptr : &it->second);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (batched ? QUERIES : 1));
+}
+BENCHMARK_TEMPLATE(BM_HashLookup, LocusHash)
+    ->ArgsProduct({{1 << 20, 1 << 23}, {0, 1}})->ArgNames({"loci", "batch"});
+BENCHMARK_TEMPLATE(BM_HashLookup, SppLocusHash)
+    ->ArgsProduct({{1 << 20, 1 << 23}, {0, 1}})->ArgNames({"loci", "batch"});
+BENCHMARK_TEMPLATE(BM_HashLookup, MixLocusHash)
+    ->ArgsProduct({{1 << 20, 1 << 23}, {0, 1}})->ArgNames({"loci", "batch"});
+BENCHMARK_TEMPLATE(BM_HashLookup, Crc32cLocusHash)
+    ->ArgsProduct({{1 << 20, 1 << 23}, {0, 1}})->ArgNames({"loci", "batch"});
+BENCHMARK_TEMPLATE(BM_HashLookup, WyLocusHash)
+    ->ArgsProduct({{1 << 20, 1 << 23}, {0, 1}})->ArgNames({"loci", "batch"});
+BENCHMARK_TEMPLATE(BM_HashLookup, Xxh3LocusHash)
+    ->ArgsProduct({{1 << 20, 1 << 23}, {0, 1}})->ArgNames({"loci", "batch"});
+
+
+static void BM_Decode(benchmark::State& state) {
+    // Decode records holding `values` values of a single feature kind
+    const FeatureKind kind = (FeatureKind)state.range(0);
+    const size_t values = (size_t)state.range(1);
+    const size_t nrecords = 4096;
+    RecordArena arena;
+    RecordsBuilder builder;
+    StringCache cache;
+    Random random(SEED + 4);
+    std::vector<Records> records;
+    for (size_t i = 0; i < nrecords; ++i) {
+        builder.begin(0, kind == STRING_FEATURE);
+        for (size_t j = 0; j < values; ++j) {
+            const std::string value = "value" + std::to_string(random.below(1000));
+            if (kind == FLOAT_FEATURE) {
+                builder.add_float((float)random.below(1000) / 1000);
+            } else if (kind == INT_FEATURE) {
+                builder.add_integer((int32_t)random.below(1000));
+            } else if (kind == CACHED_FEATURE) {
+                builder.add_integer(cache.cache(value));
+            } else {
+                builder.add_string(value);
+            }
+        }
+        records.push_back(builder.finish(arena));
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        RecordsReader reader(records[i++ % nrecords]);
+        while (reader.next()) {
+            for (uint32_t j = 0; j < reader.count; ++j) {
+                if (kind == FLOAT_FEATURE) {
+                    benchmark::DoNotOptimize(reader.number(j));
+                } else if (kind == INT_FEATURE) {
+                    benchmark::DoNotOptimize(reader.integer(j));
+                } else if (kind == CACHED_FEATURE) {
+                    benchmark::DoNotOptimize(cache.cache(reader.integer(j)));
+                } else {
+                    reader.read_string();
+                    benchmark::DoNotOptimize(reader.string_data);
+                }
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * values);
+}
+BENCHMARK(BM_Decode)->ArgsProduct({{FLOAT_FEATURE, INT_FEATURE, STRING_FEATURE,
+                                    CACHED_FEATURE}, {1, 8}})
+                    ->ArgNames({"kind", "values"});
+
+
+static void BM_StringIntern(benchmark::State& state) {
+    // Intern strings drawn from a pool of the given cardinality
+    const size_t cardinality = (size_t)state.range(0);
+    Random random(SEED + 5);
+    std::vector<std::string> strings(QUERIES);
+    for (size_t i = 0; i < QUERIES; ++i) {
+        strings[i] = "Pathogenic/Likely_pathogenic|criteria_provided|" +
+                     std::to_string(random.below(cardinality));
+    }
+    StringCache cache;
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(cache.cache(strings[i++ & (QUERIES - 1)]));
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["cached"] = (double)cache.size();
+}
+BENCHMARK(BM_StringIntern)->Arg(16)->Arg(1 << 10)->Arg(1 << 16)->ArgName("cardinality");
+
+
+static size_t heap_bytes() {
+#ifdef __GLIBC__
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+}
+
+
+static void BM_MemoryPerLocus(benchmark::State& state) {
+    // Build a table of typical records and report its footprint: the whole
+    // heap growth (table and arena; glibc only) and the arena alone
+    const size_t n = (size_t)state.range(0);
+    const std::vector<Locus> loci = make_loci(n, SEED);
+    double heap = 0, arena_bytes = 0, inline_share = 0;
+    for (auto _ : state) {
+        const size_t before = heap_bytes();
+        RecordArena arena;
+        RecordsBuilder builder;
+        Random random(SEED + 1);
+        LocusTable table;
+        table.reserve(n);
+        size_t inlined = 0;
+        for (size_t i = 0; i < n; ++i) {
+            Records& records = table[loci[i]];
+            records = make_records(builder, arena, random);
+            inlined += records.is_inline();
+        }
+        heap = (double)(heap_bytes() - before) / table.size();
+        arena_bytes = (double)arena.bytes() / table.size();
+        inline_share = (double)inlined / n;
+    }
+    state.counters["heap_bytes_per_locus"] = heap;
+    state.counters["arena_bytes_per_locus"] = arena_bytes;
+    state.counters["inline_share"] = inline_share;
+}
+BENCHMARK(BM_MemoryPerLocus)->Arg(1 << 20)->ArgName("loci")->Iterations(1)
+                            ->Unit(benchmark::kMillisecond);
+
+
+// The table backends side by side, whichever one LocusTable is built with
+// (see ANNOGEN_SWISS_TABLE in mapping.hpp): same loci, records and hash policy
+typedef spp::sparse_hash_map<Locus, Records, LocusHash> SppTable;
+typedef swiss::SwissTable<Locus, Records, LocusHash> SwissTable;
+
+
+template <class Table>
+static void BM_BackendInsert(benchmark::State& state) {
+    const size_t n = (size_t)state.range(0);
+    const bool reserve = state.range(1);
+    const std::vector<Locus> loci = make_loci(n, SEED);
+    for (auto _ : state) {
+        Table table;
+        if (reserve) {
+            table.reserve(n);
+        }
+        for (size_t i = 0; i < n; ++i) {
+            table[loci[i]] = Records();
+        }
+        benchmark::DoNotOptimize(table.size());
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_TEMPLATE(BM_BackendInsert, SppTable)
+    ->ArgsProduct({{1 << 16, 1 << 20}, {0, 1}})->ArgNames({"loci", "reserve"})
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_BackendInsert, SwissTable)
+    ->ArgsProduct({{1 << 16, 1 << 20}, {0, 1}})->ArgNames({"loci", "reserve"})
+    ->Unit(benchmark::kMillisecond);
+
+
+template <class Table>
+static void BM_BackendLookup(benchmark::State& state) {
+    // Single hits (mode 0), single misses (1) and prefetched batches of half
+    // hits, half misses (2) in a copy of the fixture table
+    Fixture& data = fixture((size_t)state.range(0));
+    Table table;
+    table.reserve(data.table.size());
+    for (LocusTable::const_iterator it = data.table.begin(); it != data.table.end(); ++it) {
+        table.insert(*it);
+    }
+    const int mode = (int)state.range(1);
+    const std::vector<Locus>& queries = mode == 1 ? data.misses : data.loci;
+    Random random(SEED + 2);
+    std::vector<Locus> order(QUERIES);
+    for (size_t i = 0; i < QUERIES; ++i) {
+        order[i] = queries[random.below(queries.size())];
+    }
+    LocusBatch batch = make_batch(data, SEED + 3);
+    batch.pack(true);
+    std::vector<const Records*> out(QUERIES);
+    LocusFilter filter;
+    size_t i = 0;
+    for (auto _ : state) {
+        if (mode == 2) {
+            lookup_batch(table, filter, batch.keys.data(), batch.hashes.data(),
+                         QUERIES, out.data());
+            benchmark::DoNotOptimize(out.data());
+        } else {
+            typename Table::const_iterator it = table.find(order[i++ & (QUERIES - 1)]);
+            benchmark::DoNotOptimize(it == table.end() ? nullptr : &it->second);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * (mode == 2 ? QUERIES : 1));
+}
+BENCHMARK_TEMPLATE(BM_BackendLookup, SppTable)
+    ->ArgsProduct({{1 << 16, 1 << 20, 1 << 23}, {0, 1, 2}})->ArgNames({"loci", "mode"});
+BENCHMARK_TEMPLATE(BM_BackendLookup, SwissTable)
+    ->ArgsProduct({{1 << 16, 1 << 20, 1 << 23}, {0, 1, 2}})->ArgNames({"loci", "mode"});
+
+
+template <class Table>
+static void BM_BackendMemory(benchmark::State& state) {
+    // Heap bytes per locus of the table alone (record handles, no blobs)
+    // after growing it one insert at a time, and its final load factor
+    const size_t n = (size_t)state.range(0);
+    const std::vector<Locus> loci = make_loci(n, SEED);
+    double heap = 0, load = 0;
+    for (auto _ : state) {
+        const size_t before = heap_bytes();
+        Table table;
+        for (size_t i = 0; i < n; ++i) {
+            table[loci[i]] = Records();
+        }
+        heap = (double)(heap_bytes() - before) / table.size();
+        load = table.load_factor();
+    }
+    state.counters["heap_bytes_per_locus"] = heap;
+    state.counters["load_factor"] = load;
+}
+BENCHMARK_TEMPLATE(BM_BackendMemory, SppTable)->Arg(1 << 20)->ArgName("loci")
+    ->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_BackendMemory, SwissTable)->Arg(1 << 20)->ArgName("loci")
+    ->Iterations(1)->Unit(benchmark::kMillisecond);
+
+
+BENCHMARK_MAIN();
@@ -0,0 +1,192 @@
+"""
+Macro benchmarks of the Python API: bulk inserts, single and batched lookups
+(hits and misses, mutable and frozen), decoding cost per dtype, string
+caching and memory per locus. Datasets come from annogen.synthetic and are
+deterministic for a given seed. Results are printed as a table and
+optionally written as JSON:
+
+    python bench.py --sizes 100000 1000000 --output bench_python.json
+
+Requires a built annogen extension (e.g. `python setup.py build_ext
+--inplace` in the repository root).
+"""
+
+import argparse
+import json
+import os
+import platform
+import random
+import sys
+import time
+from datetime import datetime, timezone
+from itertools import cycle
+from typing import Callable, List, Tuple
+
+import numpy as np
+
+# fall back to an in-place build in the repository
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             os.pardir))
+
+from annogen.synthetic import FeatureModel, SyntheticGenome
+
+Site = Tuple[str, int, str, str]
+
+
+def misses(loci: List[Site]) -> List[Site]:
+    # the same loci shifted past the end of their contig
+    return [(contig, pos + 10 ** 9, ref, alt) for contig, pos, ref, alt in loci]
+
+
+def columns(loci: List[Site]):
+    contigs, positions, refs, alts = zip(*loci)
+    return (np.array(contigs, dtype='S'), np.array(positions, dtype=np.uint32),
+            np.array(refs, dtype='S1'), np.array(alts, dtype='S1'))
+
+
+def rss() -> int:
+    # resident set size in bytes (Linux only, 0 elsewhere)
+    try:
+        with open('/proc/self/statm') as statm:
+            return int(statm.read().split()[1]) * os.sysconf('SC_PAGE_SIZE')
+    except (OSError, ValueError):
+        return 0
+
+
+class Runner:
+
+    def __init__(self, min_time: float, repeat: int):
+        self.min_time = min_time
+        self.repeat = repeat
+        self.results = []
+
+    def run(self, name: str, func: Callable[[], object], items: int,
+            **extra):
+        """
+        Call `func` (processing `items` items per call) until `min_time`
+        seconds pass, `repeat` times, and record the best rate
+        :param name: benchmark name
+        :param extra: reported along with the timings
+        """
+        best = None
+        iterations = 0
+        for _ in range(self.repeat):
+            iterations = 0
+            start = time.perf_counter()
+            while True:
+                func()
+                iterations += 1
+                elapsed = time.perf_counter() - start
+                if elapsed >= self.min_time:
+                    break
+            per_call = elapsed / iterations
+            best = per_call if best is None else min(best, per_call)
+        result = dict(name=name, iterations=iterations, seconds=best,
+                      ns_per_item=best / items * 1e9,
+                      items_per_second=items / best, **extra)
+        self.results.append(result)
+        print(f'{name:<40} {result["ns_per_item"]:>12.1f} ns/item '
+              f'{result["items_per_second"]:>14,.0f} items/s', flush=True)
+
+    def record(self, name: str, **values):
+        self.results.append(dict(name=name, **values))
+        print(f'{name:<40} ' + ' '.join(f'{k}={v:,.1f}' for k, v in
+                                        values.items()), flush=True)
+
+
+def sample(genome: SyntheticGenome, queries: int, seed: int) -> List[Site]:
+    return random.Random(seed).sample(list(genome.sites()),
+                                      min(queries, len(genome)))
+
+
+def bench_size(runner: Runner, n: int, seed: int, queries: int):
+    genome = SyntheticGenome(n, seed)
+    hits = sample(genome, queries, seed)
+    absent = misses(hits)
+
+    # inserts, and memory per locus of the result
+    before = rss()
+    start = time.perf_counter()
+    mapping = genome.mapping()
+    elapsed = time.perf_counter() - start
+    runner.record(f'insert_many/{n}', seconds=elapsed,
+                  ns_per_item=elapsed / n * 1e9, items_per_second=n / elapsed)
+    runner.record(f'memory/{n}', bytes_per_locus=(rss() - before) / len(mapping))
+
+    # single lookups
+    for label, queries in [('hit', hits), ('miss', absent)]:
+        site = cycle(queries).__next__
+        runner.run(f'getitem_{label}/{n}', lambda: mapping.getitem(*site()), 1)
+
+    # batches: half hits, half misses
+    mixed = [site for pair in zip(hits, absent) for site in pair]
+    arrays = columns(mixed)
+    runner.run(f'getitems/{n}', lambda: mapping.getitems(mixed), len(mixed))
+    runner.run(f'getitems_arrays/{n}',
+               lambda: mapping.getitems_arrays(*arrays), len(mixed))
+    mapping.build_filter(0.01)
+    runner.run(f'getitems_arrays_filter/{n}',
+               lambda: mapping.getitems_arrays(*arrays), len(mixed))
+    for index in ['eytzinger', 'mphf']:
+        frozen = genome.mapping()
+        frozen.freeze(index)
+        runner.run(f'getitems_arrays_frozen_{index}/{n}',
+                   lambda: frozen.getitems_arrays(*arrays), len(mixed))
+        del frozen
+
+
+def bench_decode(runner: Runner, n: int, seed: int, queries: int):
+    # one single-feature mapping per dtype; cached strings vs plain ones
+    hits = sample(SyntheticGenome(n, seed), queries, seed)
+    arrays = columns(hits)
+    models = {
+        'float': FeatureModel(float),
+        'int': FeatureModel(int),
+        'str': FeatureModel(str, cardinality=40),
+        'cached_str': FeatureModel(str, cardinality=40, cached=True)
+    }
+    for label, model in models.items():
+        genome = SyntheticGenome(n, seed, features={label: model})
+        start = time.perf_counter()
+        mapping = genome.mapping()
+        elapsed = time.perf_counter() - start
+        runner.record(f'insert_{label}/{n}', seconds=elapsed,
+                      ns_per_item=elapsed / n * 1e9)
+        runner.run(f'decode_{label}/{n}',
+                   lambda: mapping.getitems_arrays(*arrays), len(hits))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--sizes', type=int, nargs='+',
+                        default=[100000, 1000000])
+    parser.add_argument('--seed', type=int, default=42)
+    parser.add_argument('--queries', type=int, default=100000,
+                        help='loci per batch lookup')
+    parser.add_argument('--min-time', type=float, default=0.5,
+                        help='seconds per measurement')
+    parser.add_argument('--repeat', type=int, default=3)
+    parser.add_argument('--output', help='write results to this JSON file')
+    args = parser.parse_args()
+    runner = Runner(args.min_time, args.repeat)
+    for n in args.sizes:
+        bench_size(runner, n, args.seed, args.queries)
+        bench_decode(runner, n, args.seed, args.queries)
+    if args.output:
+        with open(args.output, 'w') as out:
+            json.dump({
+                'context': {
+                    'date': datetime.now(timezone.utc).isoformat(),
+                    'python': sys.version.split()[0],
+                    'machine': platform.machine(),
+                    'processor': platform.processor(),
+                    'seed': args.seed,
+                    'sizes': args.sizes,
+                    'queries': args.queries
+                },
+                'benchmarks': runner.results
+            }, out, indent=2)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,89 @@
+"""
+Compare hash functions of Locus keys (see GenomeMapping.hash_quality):
+bucket occupancy, probe lengths and avalanche, on synthetic key sets of
+the given sizes and on the loci of Parquet files:
+
+    python hashes.py --sizes 1000000 --parquet gnomad.parquet --output hashes.json
+
+Requires a built annogen extension (e.g. `python setup.py build_ext
+--inplace` in the repository root).
+"""
+
+import argparse
+import json
+import os
+import sys
+
+# fall back to an in-place build in the repository
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             os.pardir))
+
+from annogen.mapping import GenomeMapping
+from annogen.synthetic import SyntheticGenome
+
+LOCUS_COLUMNS = ('contig', 'pos', 'ref', 'alt')
+COLUMNS = [('uniformity', '{:.4f}'), ('empty_buckets', '{:,}'),
+           ('expected_empty', '{:,.0f}'), ('max_bucket_keys', '{}'),
+           ('hash_collisions', '{:,}'), ('mean_probes', '{:.4f}'),
+           ('max_probes', '{}'), ('mean_miss_probes', '{:.4f}'),
+           ('avalanche_bias', '{:.4f}'), ('avalanche_worst', '{:.4f}'),
+           ('index_worst', '{:.4f}')]
+
+
+def parquet_mapping(path: str, columns: dict) -> GenomeMapping:
+    # loci only: no features are read
+    import pyarrow.compute as pc
+    import pyarrow.parquet as pq
+    names = [columns.get(column, column) for column in LOCUS_COLUMNS]
+    table = pq.read_table(path, columns=names)
+    contigs = pc.unique(table[names[0]]).to_pylist()
+    alphabet = set(pc.unique(table[names[2]]).to_pylist() +
+                   pc.unique(table[names[3]]).to_pylist())
+    mapping = GenomeMapping({}, contigs, sorted(alphabet), [], [],
+                            expected_size=len(table))
+    mapping.insert_parquet(path, features=[], columns=columns)
+    return mapping
+
+
+def report(label: str, mapping: GenomeMapping, load_factor: float) -> dict:
+    results = mapping.hash_quality(load_factor=load_factor)
+    first = next(iter(results.values()))
+    print(f'\n{label}: {first["size"]:,} loci, {first["buckets"]:,} buckets')
+    print(f'{"":<18}' + ''.join(f'{name:>14}' for name in results))
+    for column, form in COLUMNS:
+        print(f'{column:<18}' + ''.join(f'{form.format(r[column]):>14}'
+                                        for r in results.values()))
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0])
+    parser.add_argument('--sizes', type=int, nargs='*', default=[1000000],
+                        help='synthetic key set sizes')
+    parser.add_argument('--seed', type=int, default=42)
+    parser.add_argument('--snv-fraction', type=float, default=0.9)
+    parser.add_argument('--parquet', nargs='*', default=[],
+                        help='files with contig, pos, ref and alt columns')
+    parser.add_argument('--columns', type=json.loads, default={},
+                        help='JSON renaming locus columns, e.g. '
+                             '\'{"contig": "chrom"}\'')
+    parser.add_argument('--load-factor', type=float, default=0.5)
+    parser.add_argument('--output', help='write results to this JSON file')
+    args = parser.parse_args()
+    results = {}
+    for n in args.sizes:
+        genome = SyntheticGenome(n, args.seed, snv_fraction=args.snv_fraction,
+                                 features={})
+        label = f'synthetic/{n}'
+        results[label] = report(label, genome.mapping(), args.load_factor)
+    for path in args.parquet:
+        results[path] = report(path, parquet_mapping(path, args.columns),
+                               args.load_factor)
+    if args.output:
+        with open(args.output, 'w') as out:
+            json.dump({'load_factor': args.load_factor, 'seed': args.seed,
+                       'key_sets': results}, out, indent=2)
+
+
+if __name__ == '__main__':
+    main()
@@ -4,6 +4,13 @@ import os
 from Cython.Build import cythonize
 
 os.environ['CFLAGS'] = '-O3 -Wall -std=c++11 -stdlib=libc++'
+# ANNOGEN_STATS=1 compiles in hot-path statistics (GenomeMapping.stats)
+if os.environ.get('ANNOGEN_STATS'):
+    os.environ['CFLAGS'] += ' -DANNOGEN_STATS=1'
+# ANNOGEN_TABLE=swiss swaps the sparsepp hash table for a Swiss table (faster
+# lookups, more memory; see annogen/swiss.hpp)
+if os.environ.get('ANNOGEN_TABLE') == 'swiss':
+    os.environ['CFLAGS'] += ' -DANNOGEN_SWISS_TABLE=1'
 
 setup(
     name="annogen",
@@ -11,5 +18,5 @@ setup(
                           include_path=["annogen/"],
                           language="c++"),
     packages=["annogen"],
-    install_requires=["cython>=0.27"]
+    install_requires=["cython>=0.29.31"]
 )
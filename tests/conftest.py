@@ -0,0 +1,29 @@
+"""
+Tests of the annogen extension; run `python -m pytest tests` against an
+installed or in-place build (`python setup.py build_ext --inplace`).
+"""
+
+import os
+import sys
+
+import pytest
+
+# fall back to an in-place build in the repository
+sys.path.append(os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                             os.pardir))
+
+from annogen.mapping import GenomeMapping
+
+FEATURES = {'AF': float, 'gene': str, 'n': int}
+
+
+def entries(n, contig='1'):
+    # AF values are exact in float32
+    return [((contig, i, 'A', 'G'),
+             {'AF': [i / 4], 'gene': [f'GENE{i % 3}'], 'n': [i]})
+            for i in range(n)]
+
+
+@pytest.fixture
+def mapping():
+    return GenomeMapping(FEATURES, ['1', '2'], 'ACGT', ['gene'], entries(100))
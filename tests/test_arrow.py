@@ -0,0 +1,130 @@
+import pytest
+
+pa = pytest.importorskip('pyarrow')
+
+from annogen.mapping import GenomeMapping
+from conftest import FEATURES, entries
+
+
+def roundtrip(mapping, **kwargs):
+    copy = GenomeMapping(FEATURES, ['1', '2'], 'ACGT', ['gene'], [])
+    copy.insert_arrow(pa.RecordBatchReader.from_stream(mapping, **kwargs))
+    return copy
+
+
+@pytest.mark.parametrize('frozen', [False, True])
+def test_roundtrip(mapping, frozen):
+    mapping.insert('2', 1, 'C', '', {'gene': ['x' * 40]})
+    mapping.insert('2', 2, 'T', 'A', {})
+    if frozen:
+        mapping.freeze()
+    copy = roundtrip(mapping)
+    sites = [site for site, _ in entries(100)] + [('2', 1, 'C', ''),
+                                                 ('2', 2, 'T', 'A')]
+    assert len(copy) == len(mapping) == 102
+    assert copy.getitems(sites) == mapping.getitems(sites)
+
+
+def test_schema(mapping):
+    table = pa.RecordBatchReader.from_stream(mapping).read_all()
+    assert table.column_names == ['contig', 'pos', 'ref', 'alt', 'AF', 'gene', 'n']
+    assert table.num_rows == 100
+    rows = {row['pos']: row for row in table.to_pylist()}
+    assert rows[3] == {'contig': '1', 'pos': 3, 'ref': 'A', 'alt': 'G',
+                       'AF': [0.75], 'gene': ['GENE0'], 'n': [3]}
+
+
+def test_small_batches(mapping):
+    reader = pa.RecordBatchReader.from_stream(mapping.arrow_stream(batch_size=7))
+    batches = list(reader)
+    assert max(len(batch) for batch in batches) == 7
+    assert sum(len(batch) for batch in batches) == 100
+
+
+def test_modified_during_export(mapping):
+    reader = pa.RecordBatchReader.from_stream(mapping.arrow_stream(batch_size=10))
+    reader.read_next_batch()
+    mapping.insert('1', 1000, 'A', 'G', {'n': [1]})
+    with pytest.raises(pa.ArrowInvalid):
+        reader.read_all()
+
+
+def test_import_errors(mapping):
+    with pytest.raises(TypeError):
+        mapping.insert_arrow([1, 2, 3])
+    table = pa.table({'pos': [1], 'ref': ['A'], 'alt': ['G']})
+    with pytest.raises(ValueError):
+        mapping.insert_arrow(table)
+
+
+
+@pytest.mark.parametrize('hash_function', ['xxh3', 'crc32c'])
+def test_hash_function_roundtrip(mapping, hash_function):
+    mapping.rehash(hash_function)
+    reader = pa.RecordBatchReader.from_stream(mapping)
+    assert reader.schema.metadata[b'annogen.hash_function'] == hash_function.encode()
+    table = reader.read_all()
+    # a mapping of the same hash function takes the data as they are
+    copy = mapping.empty_like()
+    copy.insert_arrow(table)
+    assert copy.hash_function == hash_function and len(copy) == 100
+    # another hash function is refused, even by an empty mapping...
+    other = mapping.empty_like()
+    other.rehash('spp')
+    with pytest.raises(ValueError):
+        other.insert_arrow(table)
+    # ...unless it opts in
+    other.reserve(1000)
+    buckets = other.bucket_count
+    other.insert_arrow(table, adopt_hash_function=True)
+    assert other.hash_function == hash_function
+    assert other.bucket_count >= buckets and len(other) == 100
+    assert other.getitem('1', 5, 'A', 'G') == mapping.getitem('1', 5, 'A', 'G')
+    # a mapping with loci never switches
+    other = mapping.empty_like()
+    other.rehash('mix')
+    other.insert('1', 1000, 'A', 'G', {'n': [1]})
+    with pytest.raises(ValueError):
+        other.insert_arrow(table, adopt_hash_function=True)
+    assert other.hash_function == 'mix' and len(other) == 1
+    # single record batches carry the metadata too
+    with pytest.raises(ValueError):
+        other.insert_arrow(table.to_batches()[0], adopt_hash_function=True)
+
+
+def test_foreign_data_keep_hash_function(mapping):
+    mapping.rehash('wyhash')
+    mapping.insert_arrow(pa.table({'contig': ['2'], 'pos': [1], 'ref': ['A'],
+                                   'alt': ['C']}))
+    assert mapping.hash_function == 'wyhash' and len(mapping) == 101
+
+
+def test_unknown_hash_function(mapping):
+    table = pa.RecordBatchReader.from_stream(mapping).read_all()
+    table = table.replace_schema_metadata({'annogen.hash_function': 'md5'})
+    with pytest.raises(ValueError):
+        mapping.empty_like().insert_arrow(table, adopt_hash_function=True)
+
+
+@pytest.mark.parametrize('values, dtype', [
+    ([2 ** 31], pa.int64()), ([-2 ** 31 - 1], pa.int64()),
+    ([2 ** 32 - 1], pa.uint32()), ([2 ** 64 - 1], pa.uint64())])
+def test_import_int_overflow(mapping, values, dtype):
+    table = pa.table({'contig': ['1'], 'pos': [1000], 'ref': ['A'],
+                      'alt': ['G'], 'n': pa.array([values], pa.list_(dtype))})
+    with pytest.raises(OverflowError):
+        mapping.insert_arrow(table)
+    # as for a scalar insertion
+    with pytest.raises(OverflowError):
+        mapping.insert('1', 1000, 'A', 'G', {'n': values})
+    assert mapping.getitem('1', 1000, 'A', 'G') == {}
+    table = table.set_column(4, 'n', pa.array([[2 ** 31 - 1, -2 ** 31]],
+                                              pa.list_(pa.int64())))
+    mapping.insert_arrow(table)
+    assert mapping.getitem('1', 1000, 'A', 'G') == {'n': [2 ** 31 - 1, -2 ** 31]}
+
+
+def test_requested_schema(mapping):
+    with pytest.raises(NotImplementedError):
+        mapping.__arrow_c_stream__(pa.schema([]).__arrow_c_schema__())
+    assert mapping.__arrow_c_stream__(None) is not None
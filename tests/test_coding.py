@@ -0,0 +1,55 @@
+import numpy as np
+import pytest
+
+from annogen.mapping import GenomeMapping
+
+
+@pytest.fixture
+def mapping():
+    # one non-ASCII allele among ASCII ones
+    return GenomeMapping({'n': int}, ['1', 'chrX'], ['A', 'é', 'T'], [], [
+        (('1', 1, 'A', 'é'), {'n': [1]}),
+        (('chrX', 2, 'é', ''), {'n': [2]}),
+        (('1', 3, 'A', 'T'), {'n': [3]}),
+    ])
+
+
+def test_non_ascii_alphabet(mapping):
+    assert mapping.getitem('1', 1, 'A', 'é') == {'n': [1]}
+    assert mapping.getitem('chrX', 2, 'é', '') == {'n': [2]}
+    assert mapping.getitem('1', 1, 'A', 'è') == {}
+    sites = [('1', 1, 'A', 'é'), ('chrX', 2, 'é', ''), ('1', 3, 'A', 'T'),
+             ('1', 3, 'A', 'G'), ('2', 1, 'A', 'é')]
+    assert mapping.getitems(sites) == [{'n': [1]}, {'n': [2]}, {'n': [3]}, {}, {}]
+    with pytest.raises(KeyError):
+        mapping.insert('1', 4, 'A', 'ü', {})
+
+
+def test_non_ascii_arrays(mapping):
+    contigs = np.array([b'1', b'chrX', b'1', b'1'])
+    refs = np.array(['A'.encode(), 'é'.encode(), b'A', b'A'])
+    alts = np.array(['é'.encode(), b'', b'T', b'TT'])
+    found = mapping.getitems_arrays(contigs, [1, 2, 3, 3], refs, alts)
+    assert found == [{'n': [1]}, {'n': [2]}, {'n': [3]}, {}]
+
+
+def test_ascii_arrays():
+    mapping = GenomeMapping({'n': int}, ['1'], 'ACGT', [], [
+        (('1', 1, 'A', 'G'), {'n': [1]}), (('1', 2, 'C', ''), {'n': [2]})])
+    found = mapping.getitems_arrays(np.array([b'1'] * 3), [1, 2, 1],
+                                    np.array([b'A', b'C', b'A']),
+                                    np.array([b'G', b'', b'GG']))
+    assert found == [{'n': [1]}, {'n': [2]}, {}]
+
+
+def test_non_ascii_arrow_roundtrip(mapping):
+    pa = pytest.importorskip('pyarrow')
+    copy = GenomeMapping({'n': int}, ['1', 'chrX'], ['A', 'é', 'T'], [], [])
+    copy.insert_arrow(pa.RecordBatchReader.from_stream(mapping))
+    assert copy.getitem('chrX', 2, 'é', '') == {'n': [2]}
+    assert len(copy) == 3
+
+
+def test_alphabet_items_are_single_characters():
+    with pytest.raises(ValueError):
+        GenomeMapping({}, ['1'], ['A', 'AT'], [], [])
@@ -0,0 +1,71 @@
+import pytest
+
+from conftest import entries
+
+
+@pytest.mark.parametrize('index', ['eytzinger', 'mphf'])
+def test_frozen_lookups(mapping, index):
+    expected = mapping.getitems([site for site, _ in entries(100)])
+    mapping.freeze(index)
+    assert mapping.frozen and len(mapping) == 100
+    for (site, annotations), found in zip(entries(100), expected):
+        assert mapping.getitem(*site) == annotations == found
+    assert mapping.getitems([site for site, _ in entries(100)]) == expected
+
+
+@pytest.mark.parametrize('index', ['eytzinger', 'mphf'])
+def test_frozen_misses(mapping, index):
+    mapping.freeze(index)
+    # absent positions, alleles and contigs, and unknown codes
+    sites = [('1', 100, 'A', 'G'), ('1', 5, 'A', 'T'), ('2', 5, 'A', 'G'),
+             ('X', 5, 'A', 'G'), ('1', 5, 'N', 'G')]
+    assert all(mapping.getitem(*site) == {} for site in sites)
+    assert mapping.getitems(sites) == [{}] * len(sites)
+
+
+def test_frozen_is_immutable(mapping):
+    mapping.freeze('mphf')
+    with pytest.raises(RuntimeError):
+        mapping.insert('1', 1000, 'A', 'G', {'n': [1]})
+    with pytest.raises(RuntimeError):
+        mapping.delete('1', 1, 'A', 'G')
+    # freezing again is a no-op
+    mapping.freeze('eytzinger')
+    assert mapping.getitem('1', 1, 'A', 'G')['n'] == [1]
+
+
+def test_bad_index(mapping):
+    with pytest.raises(ValueError):
+        mapping.freeze('btree')
+    assert not mapping.frozen
+
+
+@pytest.mark.parametrize('index', [None, 'eytzinger', 'mphf'])
+def test_filter(mapping, index):
+    if index:
+        mapping.freeze(index)
+    mapping.build_filter(0.001)
+    assert mapping.has_filter
+    assert mapping.getitem('1', 7, 'A', 'G')['n'] == [7]
+    assert mapping.getitem('1', 1000, 'A', 'G') == {}
+    assert mapping.getitems([site for site, _ in entries(100)]) == [
+        annotations for _, annotations in entries(100)]
+    if not index:
+        # later insertions are added to the filter
+        mapping.insert('2', 5, 'C', 'T', {'n': [5]})
+        assert mapping.getitem('2', 5, 'C', 'T') == {'n': [5]}
+
+
+@pytest.mark.parametrize('index', ['eytzinger', 'mphf'])
+def test_frozen_empty(mapping, index):
+    empty = mapping.empty_like()
+    empty.freeze(index)
+    assert len(empty) == 0 and empty.getitem('1', 7, 'A', 'G') == {}
+    assert empty.getitems([('1', 7, 'A', 'G')]) == [{}]
+
+
+def test_frozen_features_are_fixed(mapping):
+    mapping.freeze()
+    with pytest.raises(RuntimeError):
+        mapping.add_feature('score', float)
+    assert mapping.features == ['AF', 'gene', 'n']
@@ -0,0 +1,54 @@
+import pytest
+
+from annogen.mapping import GenomeMapping
+from conftest import FEATURES, entries
+
+HASHERS = ['spp', 'mix', 'crc32c', 'wyhash', 'xxh3']
+
+
+def small(n):
+    return GenomeMapping(FEATURES, ['1', '2'], 'ACGT', [], entries(n))
+
+
+@pytest.mark.parametrize('n', [1, 2, 4, 64])
+def test_hash_quality_full_table(n):
+    # at load 1 the simulated table of a power-of-two key set is full, and
+    # misses used to probe it forever
+    results = small(n).hash_quality(HASHERS, load_factor=1.0)
+    for result in results.values():
+        assert result['size'] == result['buckets'] == n
+        assert 0 <= result['empty_buckets'] < n
+        assert sum(result['probes']) == n
+        assert 1 <= result['mean_probes'] <= n
+        assert result['mean_miss_probes'] == n
+
+
+def test_hash_quality_edge_cases(mapping):
+    empty = mapping.empty_like()
+    assert empty.hash_quality('mix')['mix']['size'] == 0
+    result = mapping.hash_quality('crc32c', load_factor=0.5)['crc32c']
+    assert result['size'] == 100 and result['buckets'] == 256
+    assert sum(result['probes']) == 100
+    # frozen mappings are measured on their keys too
+    mapping.freeze()
+    assert mapping.hash_quality('spp')['spp']['size'] == 100
+    with pytest.raises(RuntimeError):
+        mapping.probe_stats()
+
+
+@pytest.mark.parametrize('load_factor', [0.0, -0.5, 1.5])
+def test_hash_quality_bad_load_factor(mapping, load_factor):
+    with pytest.raises(ValueError):
+        mapping.hash_quality('xxh3', load_factor=load_factor)
+
+
+def test_hash_quality_unknown_hasher(mapping):
+    with pytest.raises(ValueError):
+        mapping.hash_quality(['xxh3', 'md5'])
+
+
+def test_probe_stats(mapping):
+    stats = mapping.probe_stats()
+    assert stats['size'] == 100 and sum(stats['probes']) == 100
+    assert stats['mean_probes'] >= 1 and stats['mean_miss_probes'] >= 1
+    assert mapping.empty_like().probe_stats()['size'] == 0
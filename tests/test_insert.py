@@ -0,0 +1,51 @@
+import pytest
+
+from annogen.mapping import GenomeMapping
+from conftest import FEATURES, entries
+
+
+@pytest.mark.parametrize('hash_function', ['spp', 'mix', 'crc32c', 'wyhash', 'xxh3'])
+def test_insert_many_matches_insert(hash_function):
+    # more than one insert batch, growing the table on the way
+    data = entries(10000) + entries(100, contig='2')
+    batched = GenomeMapping(FEATURES, ['1', '2'], 'ACGT', ['gene'], [],
+                            hash_function=hash_function)
+    batched.insert_many(data)
+    single = GenomeMapping(FEATURES, ['1', '2'], 'ACGT', ['gene'], [],
+                           hash_function=hash_function)
+    for site, annotations in data:
+        single.insert(*site, annotations)
+    sites = [site for site, _ in data]
+    assert len(batched) == len(single) == len(data)
+    assert batched.getitems(sites) == single.getitems(sites)
+    assert all(batched.getitem(*site) == annotations for site, annotations in data)
+
+
+def test_insert_many_duplicates():
+    mapping = GenomeMapping(FEATURES, ['1'], 'AG', [], [])
+    mapping.insert_many([(('1', 1, 'A', 'G'), {'n': [1]}),
+                         (('1', 1, 'A', 'G'), {'n': [2]})])
+    assert len(mapping) == 1 and mapping.getitem('1', 1, 'A', 'G') == {'n': [2]}
+
+
+@pytest.mark.parametrize('pos', [-1, 2 ** 32])
+def test_positions_out_of_range(mapping, pos):
+    site = ('1', pos, 'A', 'G')
+    with pytest.raises(OverflowError):
+        mapping.insert(*site, {'n': [1]})
+    with pytest.raises(OverflowError):
+        mapping.insert_many([(site, {'n': [1]})])
+    for method in (mapping.getitem, mapping.getview, mapping.delete):
+        with pytest.raises(OverflowError):
+            method(*site)
+    with pytest.raises(OverflowError):
+        mapping.getitems([site])
+    assert len(mapping) == 100
+
+
+def test_largest_position(mapping):
+    site = ('1', 2 ** 32 - 1, 'A', 'G')
+    mapping.insert(*site, {'n': [1]})
+    assert mapping.getitem(*site) == mapping.getitems([site])[0] == {'n': [1]}
+    assert mapping.getitem('1', 0, 'A', 'G')['n'] == [0]
+    assert mapping.delete(*site) and len(mapping) == 100
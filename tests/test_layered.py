@@ -0,0 +1,98 @@
+import pytest
+
+from annogen.mapping import GenomeMapping, LayeredMapping
+
+FEATURES = {'AF': float, 'gene': str}
+
+
+@pytest.fixture
+def layered():
+    base = GenomeMapping(FEATURES, ['1', '2'], 'ACGT', ['gene'], [
+        (('1', i, 'A', 'G'), {'AF': [i / 2], 'gene': [f'g{i % 3}']})
+        for i in range(100)])
+    base.freeze('mphf')
+    return LayeredMapping(base)
+
+
+def sites(positions):
+    return [('1', p, 'A', 'G') for p in positions]
+
+
+def test_base_must_be_frozen():
+    with pytest.raises(ValueError):
+        LayeredMapping(GenomeMapping(FEATURES, ['1'], 'AG', [], []))
+
+
+def test_tombstones(layered):
+    layered.delete('1', 6, 'A', 'G')
+    assert layered.getitem('1', 6, 'A', 'G') == {}
+    assert layered.base.getitem('1', 6, 'A', 'G') != {}
+    # a newer layer can bring a deleted locus back
+    layered.add_layer()
+    layered.insert('1', 6, 'A', 'G', {'gene': ['back']})
+    assert layered.getitem('1', 6, 'A', 'G') == {'gene': ['back']}
+    # and a tombstone hides a locus of an older layer
+    layered.delete('1', 6, 'A', 'G')
+    assert layered.getitem('1', 6, 'A', 'G') == {}
+    # inserting again clears the tombstone of the same layer
+    layered.insert_many([(('1', 6, 'A', 'G'), {'AF': [1.0]})])
+    assert layered.getitem('1', 6, 'A', 'G') == {'AF': [1.0]}
+    assert layered.depth == 2
+
+
+def test_layers_override_base(layered):
+    layered.insert('1', 5, 'A', 'G', {'AF': [9.0]})
+    layered.add_layer()
+    layered.delete('1', 7, 'A', 'G')
+    layered.insert('2', 1, 'C', 'T', {'AF': [1.0]})
+    expected = [{'AF': [9.0]}, {}, {'AF': [4.0], 'gene': ['g2']},
+                {'AF': [1.0]}, {}]
+    queries = sites([5, 7, 8]) + [('2', 1, 'C', 'T'), ('Z', 1, 'A', 'A')]
+    assert [layered.getitem(*site) for site in queries] == expected
+    assert layered.getitems(queries) == expected
+    assert layered.getitems(queries, features=['gene']) == [
+        {}, {}, {'gene': ['g2']}, {}, {}]
+
+
+@pytest.mark.parametrize('index', ['eytzinger', 'mphf'])
+def test_compaction(layered, index):
+    layered.insert('1', 5, 'A', 'G', {'AF': [9.0]})
+    layered.delete('1', 6, 'A', 'G')
+    layered.add_layer()
+    layered.delete('1', 7, 'A', 'G')
+    layered.insert('1', 200, 'A', 'G', {'gene': ['new']})
+    queries = sites([5, 6, 7, 8, 200])
+    before = layered.getitems(queries)
+    layered.compact(index, filter_fpr=0.01)
+    assert layered.depth == 0
+    assert layered.base.frozen and layered.base.has_filter
+    # 100 loci, two deleted, one added
+    assert len(layered.base) == 99
+    assert layered.getitems(queries) == before
+    assert before[1] == before[2] == {}
+
+
+def test_negative_positions(layered):
+    for method in (layered.getitem, layered.delete):
+        with pytest.raises(OverflowError):
+            method('1', -1, 'A', 'G')
+    with pytest.raises(OverflowError):
+        layered.insert('1', -1, 'A', 'G', {})
+
+
+def test_delete_result(layered):
+    assert layered.delete('1', 6, 'A', 'G')
+    assert not layered.delete('1', 6, 'A', 'G')
+    assert not layered.delete('1', 500, 'A', 'G')
+    assert not layered.delete('X', 6, 'A', 'G')
+    # a locus only in the newest layer
+    layered.insert('2', 1, 'C', 'T', {'AF': [1.0]})
+    assert layered.delete('2', 1, 'C', 'T')
+    assert layered.getitem('2', 1, 'C', 'T') == {}
+    assert not layered.delete('2', 1, 'C', 'T')
+    # a locus of an older layer, deleted from a newer one
+    layered.insert('2', 2, 'C', 'T', {'AF': [2.0]})
+    layered.add_layer()
+    assert layered.delete('2', 2, 'C', 'T')
+    assert layered.getitems(sites([6]) + [('2', 2, 'C', 'T')]) == [{}, {}]
+    assert len(layered.base) == 100
@@ -0,0 +1,52 @@
+import numpy as np
+import pytest
+
+from annogen.mapping import GenomeMapping, MappingSet
+from conftest import FEATURES, entries
+
+
+def source(hash_function, offset, frozen=False):
+    mapping = GenomeMapping(FEATURES, ['1', '2'], 'ACGT', ['gene'],
+                            entries(100)[offset::3],
+                            hash_function=hash_function)
+    if frozen:
+        mapping.freeze()
+    return mapping
+
+
+@pytest.fixture
+def sources():
+    # alternating hash functions and a frozen mapping in between
+    return MappingSet({'a': source('xxh3', 0), 'b': source('mix', 1, True),
+                       'c': source('mix', 2), 'd': source('xxh3', 1)})
+
+
+def test_lookup_across_hash_functions(sources):
+    sites = [site for site, _ in entries(100)] + [('1', 500, 'A', 'G'),
+                                                 ('X', 1, 'A', 'G')]
+    found = sources.getitems(sites)
+    for (_, pos, _, _), annotations in entries(100):
+        names = {0: ['a'], 1: ['b', 'd'], 2: ['c']}[pos % 3]
+        assert found[pos] == {name: annotations for name in names}
+    assert found[-2:] == [{}, {}]
+    contigs = np.array([site[0].encode() for site in sites])
+    refs = np.array([site[2].encode() for site in sites])
+    alts = np.array([site[3].encode() for site in sites])
+    assert sources.getitems_arrays(contigs, [site[1] for site in sites],
+                                   refs, alts) == found
+
+
+def test_projections(sources):
+    found = sources.getitems([('1', 4, 'A', 'G')], features={'d': ['n']})
+    assert found == [{'b': {'AF': [1.0], 'gene': ['GENE1'], 'n': [4]},
+                      'd': {'n': [4]}}]
+    with pytest.raises(KeyError):
+        sources.getitems([('1', 4, 'A', 'G')], features={'z': ['n']})
+
+
+def test_mappings_must_share_coding():
+    with pytest.raises(ValueError):
+        MappingSet({})
+    with pytest.raises(ValueError):
+        MappingSet({'a': source('spp', 0),
+                    'b': GenomeMapping(FEATURES, ['1'], 'ACGT', [], [])})
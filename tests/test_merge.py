@@ -0,0 +1,70 @@
+import pytest
+
+from annogen.mapping import GenomeMapping
+from conftest import FEATURES
+
+
+def target():
+    mapping = GenomeMapping(FEATURES, ['1', '2'], 'ACGT', ['gene'], [
+        (('1', 1, 'A', 'G'), {'AF': [0.5], 'gene': ['A']}),
+        (('1', 2, 'A', 'G'), {'n': [1]}),
+    ])
+    mapping.build_filter()
+    return mapping
+
+
+def source(frozen):
+    # different feature order, contig and base codes, no cached strings
+    mapping = GenomeMapping({'gene': str, 'AF': float}, ['2', '1'], 'GACT', [], [
+        (('1', 1, 'A', 'G'), {'AF': [0.25], 'gene': ['B' * 40]}),
+        (('2', 9, 'C', ''), {'gene': ['C']}),
+    ])
+    if frozen:
+        mapping.freeze()
+    return mapping
+
+
+@pytest.mark.parametrize('frozen', [False, True])
+@pytest.mark.parametrize('policy, expected', [
+    ('keep', {'AF': [0.5], 'gene': ['A']}),
+    ('overwrite', {'AF': [0.25], 'gene': ['B' * 40]}),
+    ('concatenate', {'AF': [0.5, 0.25], 'gene': ['A', 'B' * 40]}),
+    ('replace', {'AF': [0.25], 'gene': ['B' * 40]}),
+])
+def test_merge_policies(policy, expected, frozen):
+    mapping = target()
+    mapping.merge(source(frozen), policy)
+    assert len(mapping) == 3
+    assert mapping.getitem('1', 1, 'A', 'G') == expected
+    assert mapping.getitem('1', 2, 'A', 'G') == {'n': [1]}
+    assert mapping.getitem('2', 9, 'C', '') == {'gene': ['C']}
+
+
+def test_merge_keeps_features_of_one_side():
+    mapping = target()
+    other = GenomeMapping(FEATURES, ['1'], 'AG', [], [
+        (('1', 1, 'A', 'G'), {'n': [7]})])
+    mapping.merge(other, 'keep')
+    assert mapping.getitem('1', 1, 'A', 'G') == {'AF': [0.5], 'gene': ['A'],
+                                                 'n': [7]}
+    mapping.merge(other, 'replace')
+    assert mapping.getitem('1', 1, 'A', 'G') == {'n': [7]}
+
+
+def test_merge_errors():
+    mapping = target()
+    with pytest.raises(ValueError):
+        mapping.merge(mapping)
+    with pytest.raises(ValueError):
+        mapping.merge(source(False), 'append')
+    with pytest.raises(ValueError):
+        mapping.merge(GenomeMapping({'zz': int}, ['1'], 'A', [], []))
+    with pytest.raises(ValueError):
+        mapping.merge(GenomeMapping({'n': float}, ['1'], 'A', [], []))
+    with pytest.raises(ValueError):
+        mapping.merge(GenomeMapping({'n': int}, ['7'], 'A', [],
+                                    [(('7', 1, 'A', 'A'), {})]))
+    frozen = target()
+    frozen.freeze()
+    with pytest.raises(RuntimeError):
+        frozen.merge(source(False))
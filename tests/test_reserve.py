@@ -0,0 +1,69 @@
+import pytest
+
+from annogen.mapping import GenomeMapping
+from conftest import FEATURES, entries
+
+
+class Entries:
+    # entries recording the bucket count of `mapping` before each of them
+
+    def __init__(self, mapping, data):
+        self.mapping = mapping
+        self.data = data
+
+    def __iter__(self):
+        for entry in self.data:
+            self.mapping.buckets.add(self.mapping.bucket_count)
+            yield entry
+
+
+class SizedEntries(Entries):
+
+    def __len__(self):
+        return len(self.data)
+
+
+class Watched(GenomeMapping):
+
+    def __init__(self, data, sized, **kwargs):
+        self.buckets = set()
+        entries = (SizedEntries if sized else Entries)(self, data)
+        super().__init__(FEATURES, ['1', '2'], 'ACGT', ['gene'], entries,
+                         **kwargs)
+
+
+@pytest.mark.parametrize('sized, expected_size', [
+    (True, None), (False, 5000), (False, 8000)])
+def test_presized_bulk_load_does_not_rehash(sized, expected_size):
+    mapping = Watched(entries(5000), sized, expected_size=expected_size)
+    assert len(mapping) == 5000
+    assert mapping.buckets == {mapping.bucket_count}
+
+
+def test_unsized_bulk_load_rehashes():
+    mapping = Watched(entries(5000), False)
+    assert len(mapping) == 5000 and len(mapping.buckets) > 1
+
+
+def test_reserve_does_not_rehash():
+    mapping = GenomeMapping(FEATURES, ['1', '2'], 'ACGT', ['gene'], [])
+    mapping.reserve(5000)
+    buckets = mapping.bucket_count
+    assert buckets >= 5000
+    for site, annotations in entries(5000):
+        mapping.insert(*site, annotations)
+        assert mapping.bucket_count == buckets
+    # reserving less than the table holds keeps it as is
+    mapping.reserve(10)
+    assert mapping.bucket_count == buckets and len(mapping) == 5000
+    assert mapping.getitem('1', 4999, 'A', 'G')['n'] == [4999]
+
+
+def test_load_factors():
+    mapping = GenomeMapping(FEATURES, ['1'], 'AG', [], [], expected_size=1000,
+                            max_load_factor=0.8)
+    assert 1000 <= mapping.bucket_count * 0.8 < 2000
+    for min_load_factor, max_load_factor in [(0, 0), (0, 1.5), (0.5, 0.5),
+                                             (-0.1, 0.5)]:
+        with pytest.raises(ValueError):
+            mapping.set_resizing_parameters(min_load_factor, max_load_factor)
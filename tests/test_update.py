@@ -0,0 +1,71 @@
+import numpy as np
+import pytest
+
+from annogen.mapping import GenomeMapping
+from conftest import FEATURES, entries
+
+
+def test_update(mapping):
+    mapping.update('1', 5, 'A', 'G', {'n': [0], 'gene': ['new']})
+    assert mapping.getitem('1', 5, 'A', 'G') == {'AF': [1.25], 'gene': ['new'],
+                                                 'n': [0]}
+    with pytest.raises(KeyError):
+        mapping.update('1', 500, 'A', 'G', {'n': [0]})
+
+
+def test_delete(mapping):
+    assert mapping.delete('1', 5, 'A', 'G')
+    assert not mapping.delete('1', 5, 'A', 'G')
+    assert not mapping.delete('X', 5, 'A', 'G')
+    assert len(mapping) == 99 and mapping.getitem('1', 5, 'A', 'G') == {}
+
+
+def test_compact_keeps_live_records(mapping):
+    for pos in range(0, 100, 2):
+        mapping.delete('1', pos, 'A', 'G')
+    mapping.update('1', 1, 'A', 'G', {'gene': ['x' * 40]})
+    mapping.compact()
+    assert len(mapping) == 50
+    expected = [{} if pos % 2 == 0 else annotations
+                for (_, pos, _, _), annotations in entries(100)]
+    expected[1] = dict(expected[1], gene=['x' * 40])
+    assert mapping.getitems([site for site, _ in entries(100)]) == expected
+
+
+def test_append(mapping):
+    mapping.append('1', 5, 'A', 'G', {'n': [6], 'AF': [0.5]})
+    assert mapping.getitem('1', 5, 'A', 'G') == {'AF': [1.25, 0.5],
+                                                 'gene': ['GENE2'], 'n': [5, 6]}
+    with pytest.raises(KeyError):
+        mapping.append('1', 500, 'A', 'G', {'n': [0]})
+
+
+def test_add_column(mapping):
+    mapping.add_feature('score', float)
+    with pytest.raises(ValueError):
+        mapping.add_feature('score', float)
+    updated = mapping.add_column('score', np.array([b'1'] * 3), [1, 2, 500],
+                                 np.array([b'A'] * 3), np.array([b'G'] * 3),
+                                 [[0.5], [0.25], [1.0]])
+    assert updated == 2
+    assert mapping.getitem('1', 1, 'A', 'G')['score'] == [0.5]
+    assert 'score' not in mapping.getitem('1', 3, 'A', 'G')
+    assert mapping.getitem('1', 2, 'A', 'G')['n'] == [2]
+
+
+def test_compact_shrinks_table():
+    mapping = GenomeMapping(FEATURES, ['1'], 'AG', [], entries(5000))
+    buckets = mapping.bucket_count
+    for pos in range(100, 5000):
+        mapping.delete('1', pos, 'A', 'G')
+    # the default min_load_factor never shrinks on its own
+    assert mapping.bucket_count == buckets
+    mapping.compact()
+    assert mapping.bucket_count < buckets / 8
+    assert len(mapping) == 100 and mapping.load_factor > 0.1
+    assert mapping.getitems([site for site, _ in entries(100)]) == [
+        annotations for _, annotations in entries(100)]
+    # a table that fits its loci is left as it is
+    buckets = mapping.bucket_count
+    mapping.compact()
+    assert mapping.bucket_count == buckets
@@ -0,0 +1,67 @@
+import pytest
+
+from annogen.mapping import GenomeMapping
+from conftest import entries
+
+
+def test_view(mapping):
+    view = mapping.getview('1', 5, 'A', 'G')
+    assert view.valid and view['n'] == [5] and view.gene == ['GENE2']
+    assert set(view) == {'AF', 'gene', 'n'} and len(view) == 3
+    assert view.todict() == mapping.getitem('1', 5, 'A', 'G')
+    assert view.get('missing', 0) == 0 and 'AF' in view
+    assert mapping.getview('1', 500, 'A', 'G') is None
+    views = mapping.getviews([('1', 1, 'A', 'G'), ('X', 1, 'A', 'G')])
+    assert views[0]['n'] == [1] and views[1] is None
+
+
+@pytest.mark.parametrize('modify', [
+    lambda m: m.reserve(100000),
+    lambda m: m.set_resizing_parameters(0.0, 0.25),
+    lambda m: m.rehash('mix'),
+    lambda m: m.insert('1', 1000, 'A', 'G', {'n': [1]}),
+    lambda m: m.insert_many(entries(5000)),
+    lambda m: m.update('1', 5, 'A', 'G', {'n': [0]}),
+    lambda m: m.delete('1', 6, 'A', 'G'),
+    lambda m: m.compact(),
+    lambda m: m.add_feature('extra', int),
+    lambda m: m.merge(GenomeMapping({'n': int}, ['1'], 'AG', [], [])),
+    lambda m: m.freeze(),
+], ids=['reserve', 'set_resizing_parameters', 'rehash', 'insert',
+        'insert_many',
+        'update', 'delete', 'compact', 'add_feature', 'merge', 'freeze'])
+def test_modification_invalidates_views(mapping, modify):
+    view = mapping.getview('1', 5, 'A', 'G')
+    modify(mapping)
+    assert not view.valid
+    with pytest.raises(RuntimeError):
+        view['gene']
+    with pytest.raises(RuntimeError):
+        view.todict()
+    assert repr(view) == '<RecordView (invalid)>'
+
+
+def test_reserve_invalidates_exports(mapping):
+    pa = pytest.importorskip('pyarrow')
+    reader = pa.RecordBatchReader.from_stream(mapping.arrow_stream(batch_size=10))
+    reader.read_next_batch()
+    mapping.reserve(100000)
+    with pytest.raises(pa.ArrowInvalid):
+        reader.read_all()
+
+
+def test_projected_views(mapping):
+    view = mapping.getview('1', 5, 'A', 'G', features=['n', 'AF'])
+    assert view['n'] == [5] and view.AF == [1.25]
+    with pytest.raises(KeyError):
+        view['gene']
+    assert view.get('gene') is None and 'gene' not in view
+    assert set(view) == {'AF', 'n'} and len(view) == 2
+    assert view.todict() == mapping.getitem('1', 5, 'A', 'G', features=['n', 'AF'])
+    assert repr(view) == "<RecordView ['AF', 'n']>"
+    views = mapping.getviews([('1', 1, 'A', 'G'), ('X', 1, 'A', 'G')],
+                             features=['gene'])
+    assert views[0].todict() == {'gene': ['GENE1']} and views[1] is None
+    assert mapping.getviews([('1', 1, 'A', 'G')], features=[])[0].todict() == {}
+    with pytest.raises(KeyError):
+        mapping.getview('1', 5, 'A', 'G', features=['missing'])